@@ -12,23 +12,89 @@
 int main(int argc, char* argv[])
 {
   std::string optLevel_str = "0";
+  bool optSweep = false;
+  std::string compareFname;
+  std::string compareOpt;
+  bool comparePathsFlag = false;
   std::string cppFname;
   std::string irFname;
   std::string fxnName;
+  std::string fpgaFamily;
+  std::string costModelFname;
+  std::string callSummaryFname;
+  int callLatency = 0;
+  int callArea = 0;
+  int recursionRounds = 8;
+  int listWidth = 0;
+  bool liveTimelineFlag = false;
+  bool isomorphicFlag = false;
+  bool profileFlag = false;
+  bool noStaticWeights = false;
+  std::string profileEntry;
+  std::string profileArgs;
+  bool limitFlag = false;
+  std::string limitWindows = "16 64 256 1024";
+  double rooflineOps = 0;
+  double rooflineBandwidth = 0;
+  std::string dotDir;
+  std::string dotCluster = "block";
+  std::string dagDir;
 
   int builtinTest = -1;
   int iters = 5;
   int genDot = -1;
+  int threads = 1;
+  int dotTopPaths = 0;
+  int dotMaxNodes = 2000;
   bool dotFlag = false;
+  bool dotSummaryFlag = false;
+  bool svgFlag = false;
+  bool dotNoFold = false;
+  bool dotNoChains = false;
+  bool hashConsFlag = false;
+  std::string simdLevel = "auto";
 
   CLI::App app{"LLVM Estimator"};
   app.add_option("--opt", optLevel_str, "the load balancer type to use");
+  app.add_flag("--opt-sweep", optSweep, "Optimize the IR at every level (0, 1, 2, 3, s, z) at once and print the instructions, operator depth and width of each function side by side");
+  app.add_option("--compare", compareFname, "An IR file to compare --ir against: the change of each metric of every function that differs");
+  app.add_option("--compare-opt", compareOpt, "The opt level of the compared IR, or of a copy of --ir without --compare [default: --opt]");
+  app.add_flag("--compare-paths", comparePathsFlag, "Also diff the critical path of each function that differs");
   app.add_option("--cpp", cppFname, "A C++ file to generate IR from");
   app.add_option("--ir", irFname, "An IR file to read in");
   app.add_option("--builtin", builtinTest, "The number of the built-in test to run");
   app.add_option("--fxn", fxnName, "The name of the function in the IR file to analyze");
   app.add_option("--iters,-i", iters, "The number of iterations for buildint tests 1-3");
   app.add_option("--gendot", genDot, "Set to '1' to generate .dot files along with the analysis [generated to dotFiles/]");
+  app.add_option("--dot-dir", dotDir, "The directory .dot files are written to (implies --gendot 1) [default: dotFiles/]");
+  app.add_option("--emit-dag", dagDir, "Write each DAG in the binary .dag format (see src/DAGFile.h) to this directory");
+  app.add_flag("--svg", svgFlag, "Draw each DAG to <fxn>_Graph.svg in the DOT directory with the built-in layered layout (no GraphViz needed)");
+  app.add_flag("--dot-summary", dotSummaryFlag, "Also write a reduced <fxn>_Summary.dot that GraphViz can lay out for large DAGs (implies --gendot 1)");
+  app.add_option("--dot-cluster", dotCluster, "Summary clusters: block, loop or none [default: block]");
+  app.add_option("--dot-top-paths", dotTopPaths, "Summary keeps only the K most critical paths [default: all nodes]");
+  app.add_option("--dot-max-nodes", dotMaxNodes, "Summary keeps at most this many nodes, those on the longest paths (0 for no cap) [default: 2000]");
+  app.add_flag("--dot-no-fold", dotNoFold, "Summary does not fold isomorphic subgraphs");
+  app.add_flag("--dot-no-chains", dotNoChains, "Summary does not collapse linear chains");
+  app.add_option("--fpga", fpgaFamily, "The built-in operator cost model to use (generic, xilinx-ultrascale, intel-stratix10, lattice-ecp5)");
+  app.add_option("--cost-model", costModelFname, "A file of per-opcode latency/area costs applied on top of --fpga");
+  app.add_option("--call-summaries", callSummaryFname, "A file of latency/area costs of library functions and intrinsics called without a body");
+  app.add_option("--call-latency", callLatency, "The latency of an indirect call or of a function missing from --call-summaries [default: 0]");
+  app.add_option("--call-area", callArea, "The area of an indirect call or of a function missing from --call-summaries [default: 0]");
+  app.add_option("--recursion-rounds", recursionRounds, "The most fixpoint rounds spent on a recursive function, each unrolls the recursion once more [default: 8]");
+  app.add_option("--peak-ops", rooflineOps, "The peak operations per second of the target, for the roofline bound");
+  app.add_option("--peak-bw", rooflineBandwidth, "The peak memory bandwidth of the target in bytes per second, for the roofline bound");
+  app.add_option("--list-width", listWidth, "Operators per step of the list schedule the live values are measured on [default: operators / ASAP steps]");
+  app.add_flag("--live-timeline", liveTimelineFlag, "Write the live values and bits of each step to <fxn>_Live.csv in the DOT directory");
+  app.add_flag("--isomorphic", isomorphicFlag, "Group isomorphic, independent expression trees and report the width and depth once packed into vector lanes");
+  app.add_flag("--profile", profileFlag, "Run the function under the JIT and weight the estimates by the measured block and edge counts");
+  app.add_flag("--no-static-weights", noStaticWeights, "Do not weight the functions that were not profiled by their static block frequencies");
+  app.add_flag("--limit-study", limitFlag, "Run the function under the JIT and report its dynamic critical path and speedup bound per window size");
+  app.add_option("--limit-windows", limitWindows, "The window sizes of --limit-study, separated by spaces [default: 16 64 256 1024]");
+  app.add_option("--profile-entry", profileEntry, "The function run by --profile and --limit-study [default: --fxn, else main]");
+  app.add_option("--profile-args", profileArgs, "The arguments of the run, separated by spaces: numbers, and buffer sizes in bytes for pointers [default: 64, 1.0, 65536]");
+  app.add_flag("--hash-cons", hashConsFlag, "Merge structurally identical subexpressions and report the area saved by sharing them");
+  app.add_option("--simd", simdLevel, "Vector kernels used to schedule the DAG: auto, avx512, avx2 or scalar [default: auto]");
+  app.add_option("--threads,-j", threads, "The number of threads used to build the DAG (0 for all cores)");
 
   if (argc > 1){
     try {
@@ -58,6 +124,84 @@ int main(int argc, char* argv[])
     }
   }
 
+  if (!dotDir.empty())
+  {
+    dotFlag = true;
+    setDOTDirectory(dotDir);
+  }
+
+  setSVGOutput(svgFlag);
+  setHashConsing(hashConsFlag);
+  if (!setSIMDLevel(simdLevel))
+  {
+    std::cerr << "SIMD level '" << simdLevel << "' is unknown or not supported by this CPU" << std::endl;
+    return 1;
+  }
+  setDAGDirectory(dagDir);
+
+  if (dotSummaryFlag)
+  {
+    if (dotTopPaths < 0 || dotMaxNodes < 0 ||
+        !setDOTSummary(dotCluster, dotTopPaths, dotMaxNodes, !dotNoFold, !dotNoChains)){
+      std::cerr << "Not an acceptable option for the DOT summary" << std::endl;
+      return 1;
+    }
+    dotFlag = true;
+  }
+
+  if (!loadCostModel(fpgaFamily, costModelFname)){
+    std::cerr << "Could not load the operator cost model" << std::endl;
+    return 1;
+  }
+
+  if (!loadCallSummaries(callSummaryFname, callLatency, callArea)){
+    std::cerr << "Could not load the call summaries" << std::endl;
+    return 1;
+  }
+
+  if (recursionRounds < 1){
+    std::cerr << "Not an acceptable option for --recursion-rounds" << std::endl;
+    return 1;
+  }
+  setRecursionRounds(recursionRounds);
+
+  if (listWidth < 0){
+    std::cerr << "Not an acceptable option for --list-width" << std::endl;
+    return 1;
+  }
+  setLiveValues(listWidth, liveTimelineFlag);
+  setIsomorphicGroups(isomorphicFlag);
+  setProfile(profileFlag, profileEntry, profileArgs);
+  setStaticWeights(!noStaticWeights);
+  if (!setLimitStudy(limitFlag, limitWindows)){
+    std::cerr << "Not an acceptable option for --limit-windows" << std::endl;
+    return 1;
+  }
+
+  if (!setRoofline(rooflineOps, rooflineBandwidth)){
+    std::cerr << "Not an acceptable option for --peak-ops or --peak-bw" << std::endl;
+    return 1;
+  }
+
+  if (threads < 0){
+    std::cerr << "Not an acceptable option for --threads" << std::endl;
+    return 1;
+  }
+  setAnalysisThreads(threads);
+
+  if (optSweep && (irFname.empty() || dotFlag || svgFlag || !dagDir.empty() || liveTimelineFlag ||
+                   profileFlag || limitFlag)){
+    std::cerr << "--opt-sweep needs --ir, writes no files and runs nothing under the JIT" << std::endl;
+    return 1;
+  }
+
+  bool compareFlag = !compareFname.empty() || !compareOpt.empty();
+  if (compareFlag && (irFname.empty() || !fxnName.empty() || optSweep || dotFlag || svgFlag || !dagDir.empty() ||
+                      liveTimelineFlag || profileFlag || limitFlag)){
+    std::cerr << "--compare needs --ir, compares whole modules, writes no files and runs nothing under the JIT" << std::endl;
+    return 1;
+  }
+
   bool ranTest = false;
   if (!cppFname.empty()){
     std::cerr << "Do not yet support generated LLVM functions directly from C++ source" << std::endl;
@@ -68,17 +212,28 @@ int main(int argc, char* argv[])
   if (!irFname.empty()){
     ranTest = true;
     std::unique_ptr<llvm::Module> module = readIRFile(irFname, context);
-    for (auto iter=module->begin(); iter!=module->end(); ++iter){
-      llvm::Function& f = *iter;
-      if (fxnName.empty()){ //no specific request
-        runEstimatorAnalysis(f, llvmOptLevel, dotFlag);
-      } 
-      else if (fxnName == f.getName()) {
-        runEstimatorAnalysis(f, llvmOptLevel, dotFlag);
-      }
+    if (compareFlag){
+      std::unique_ptr<llvm::Module> other = compareFname.empty() ? llvm::CloneModule(*module) : readIRFile(compareFname, context);
+      if (other)
+        runCompare(*module, optLevel_str, *other, compareOpt.empty() ? optLevel_str : compareOpt, comparePathsFlag);
+    }
+    else if (optSweep){
+      if (fxnName.empty() || module->getFunction(fxnName) != nullptr)
+        runOptSweep(*module, fxnName);
+      else
+        std::cerr << fxnName << " not found in module" << std::endl;
+    }
+    else if (fxnName.empty()){ //no specific request
+      runModuleAnalysis(*module, llvmOptLevel, dotFlag);
     }
-    if (!fxnName.empty()) {
-      std::cerr << fxnName << " not found in module" << std::endl;
+    else {
+      llvm::Function *f = module->getFunction(fxnName);
+      if (f != nullptr && !f->isDeclaration()) {
+        runEstimatorAnalysis(*f, llvmOptLevel, dotFlag);
+      }
+      else {
+        std::cerr << fxnName << " not found in module" << std::endl;
+      }
     }
   }
 
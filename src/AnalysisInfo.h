@@ -1,11 +1,120 @@
 #ifndef ANALYSIS_INFO_H
 #define ANALYSIS_INFO_H
 
+#include <unordered_map>
 #include <LLVMHeaders.h>
 
 class FunctionAnalysisInfo;
 typedef std::map<llvm::Function*, FunctionAnalysisInfo*> FunctionAnalysis_t;
 
+/// Runs of each block and CFG edge per call of their function
+typedef std::unordered_map<const llvm::BasicBlock*, double> BlockFrequency_t;
+typedef std::map<std::pair<const llvm::BasicBlock*, const llvm::BasicBlock*>, double> EdgeFrequency_t;
+
+/// Peak throughput of the target for the roofline bound (ops/s and
+/// bytes/s), 0 if not given
+extern double peakOps;
+extern double peakBandwidth;
+
+
+/// Operations against bytes moved, and the roofline bound if the peaks
+/// are given: memory bound below the ridge point peakOps/peakBandwidth
+inline void printIntensity(uint64_t opCount, uint64_t bytes)
+{
+	if ( bytes == 0 )
+		return;
+	double intensity = (double)opCount / bytes;
+	llvm::outs() << "\t    Ops per Byte = " << llvm::format("%.3g", intensity) << "\n";
+	if ( peakOps > 0 && peakBandwidth > 0 )
+	{
+		double memoryBound = intensity * peakBandwidth;
+		llvm::outs() << "\t        Roofline = " << (memoryBound < peakOps ? "memory" : "compute")
+		             << " bound, " << llvm::format("%.3g", std::min(memoryBound, peakOps))
+		             << " of " << llvm::format("%.3g", peakOps) << " ops/s\n";
+	}
+}
+
+
+/// Static traffic of a loop: one iteration of its body, the bodies of its
+/// inner loops and the callees it calls counted once
+struct LoopAnalysisInfo
+{
+	std::string header;
+	unsigned depth;
+	uint64_t opCount;
+	uint64_t bytesRead;
+	uint64_t bytesWritten;
+	double trips;			//header runs per entry into the loop, 0 if not weighted
+	double weightedOps;		//operations per call of the function
+};
+
+
+/// One call of a function with each block counted as often as it runs
+/// per call (see FunctionInfoPass::gatherAnalysis)
+struct WeightedAnalysisInfo
+{
+	std::string source;		//where the frequencies come from, empty if not weighted
+	uint64_t calls;			//profiled calls
+	double instCount;
+	double readCount;
+	double writeCount;
+	double opCount;			//callees included, by their own weights if they have any
+	double bytes;
+	double opDepth;			//critical path, each latency times the runs of its block
+
+	WeightedAnalysisInfo() : calls(0), instCount(0), readCount(0), writeCount(0),
+		opCount(0), bytes(0), opDepth(0) {}
+};
+
+
+/// Operators of one unit class: their bits (lanes times the bits of one
+/// lane) as declared and narrowed by known bits, the most bits in flight
+/// in the ASAP schedule and the area at the narrowed widths
+struct DatapathAnalysisInfo
+{
+	std::string unit;
+	unsigned operators;
+	uint64_t bits;
+	uint64_t declaredBits;
+	uint64_t peakBits;
+	int area;
+	int declaredArea;
+};
+
+
+/// An operator of the critical path (see DAGBuilder::findCriticalPath)
+struct PathStepInfo
+{
+	std::string opcode;		//calls include the callee
+	std::string name;		//of its value, empty if unnamed
+	int latency;
+};
+
+
+/// Independent expression trees of one shape, see IsomorphicGroups
+struct IsomorphicGroupInfo
+{
+	std::string root;		//opcode of the roots
+	unsigned lanes;			//trees
+	unsigned operators;		//per tree
+	unsigned depth;
+};
+
+/// Trees that could share a SIMD or replicated-lane datapath, and the
+/// operator width and depth before and after packing them
+struct IsomorphicAnalysisInfo
+{
+	std::vector<IsomorphicGroupInfo> Groups;	//in the order they were taken
+	unsigned lanes;
+	uint64_t packedOperators;	//operators in the packed trees, shared ones once
+	uint64_t operators;			//0 if the analysis did not run
+	unsigned scalarWidth, scalarDepth;
+	unsigned vectorWidth, vectorDepth;
+
+	IsomorphicAnalysisInfo() : lanes(0), packedOperators(0), operators(0),
+		scalarWidth(0), scalarDepth(0), vectorWidth(0), vectorDepth(0) {}
+};
+
 
 class BaseAnalysisInfo
 {
@@ -14,14 +123,43 @@ class BaseAnalysisInfo
 		unsigned bbCount;
 		unsigned readCount;
 		unsigned writeCount;
+		uint64_t bytesRead;		//DataLayout store sizes, callees included
+		uint64_t bytesWritten;
+		uint64_t opCount;		//arithmetic operations (vector lanes), callees included
 		int varWidth;
 		int varDepth;
 		int opWidth;
 		int opDepth;
+		int area;
+		int vectorOps;			//operators on vector lanes
+		int dataMoves;			//shuffles, extracts and inserts
+		uint64_t datapathBits;	//operator bits, narrowed by known bits
+		uint64_t declaredBits;	//operator bits of the IR types
+		uint64_t valueBitWidth;	//most value bits on one ASAP level
+		uint64_t opBitWidth;	//peak operator bits in flight
+		unsigned nodeCount;		//DAG nodes, after hash-consing if enabled
+		unsigned rawNodeCount;	//DAG nodes before hash-consing, 0 if disabled
+		int rawArea;			//operator area before hash-consing
+		unsigned unknownCalls;	//calls costed with the unknown call cost
+		unsigned recursionRounds;	//fixpoint rounds of a recursive SCC, 0 if not recursive
+		bool recursionConverged;
+		int liveValues;			//peak values held, ASAP schedule
+		uint64_t liveBits;
+		int listLiveValues;		//peak values held, list schedule
+		uint64_t listLiveBits;
+		unsigned listWidth;		//operators per step of the list schedule
+		unsigned asapSteps;
+		unsigned listSteps;
 
 		BaseAnalysisInfo() :
 			instCount(0), bbCount(0), readCount(0), writeCount(0), 
-			varWidth(0), varDepth(0), opWidth(0), opDepth(0) {}
+			bytesRead(0), bytesWritten(0), opCount(0),
+			varWidth(0), varDepth(0), opWidth(0), opDepth(0), area(0),
+			vectorOps(0), dataMoves(0), datapathBits(0), declaredBits(0),
+			valueBitWidth(0), opBitWidth(0), nodeCount(0), rawNodeCount(0), rawArea(0),
+			unknownCalls(0), recursionRounds(0), recursionConverged(false),
+			liveValues(0), liveBits(0), listLiveValues(0), listLiveBits(0),
+			listWidth(0), asapSteps(0), listSteps(0) {}
 		~BaseAnalysisInfo(){}
 
 		void printAnalysis()
@@ -30,16 +168,52 @@ class BaseAnalysisInfo
 			llvm::outs() << "\t         bbCount = " << bbCount << "\n";
 			llvm::outs() << "\t       readCount = " << readCount << "\n";
 			llvm::outs() << "\t      writeCount = " << writeCount << "\n";
+			if (bytesRead + bytesWritten + opCount != 0)
+			{
+				llvm::outs() << "\t      Bytes Read = " << bytesRead << "\n";
+				llvm::outs() << "\t   Bytes Written = " << bytesWritten << "\n";
+				llvm::outs() << "\t      Operations = " << opCount << "\n";
+				printIntensity(opCount, bytesRead + bytesWritten);
+			}
 			if (varDepth != 0)
 			{
 				llvm::outs() << "\t  Variable Width = " << varWidth << "\n";
 				llvm::outs() << "\t  Variable Depth = " << varDepth << "\n";
 			}
-			// if (opDepth != 0)
-			// {
-			// 	llvm::outs() << "\t  Operator Width = " << opWidth << "\n";
-			// 	llvm::outs() << "\t  Operator Depth = " << opDepth << "\n";
-			// }
+			if (opDepth != 0)
+			{
+				llvm::outs() << "\t  Operator Width = " << opWidth << "\n";
+				llvm::outs() << "\t  Operator Depth = " << opDepth << " cycles\n";
+				llvm::outs() << "\t   Operator Area = " << area << "\n";
+			}
+			if (declaredBits != 0)
+			{
+				llvm::outs() << "\t   Datapath Bits = " << datapathBits << " of " << declaredBits << " declared\n";
+				llvm::outs() << "\t       Bit Width = " << valueBitWidth << " value, " << opBitWidth << " operator\n";
+			}
+			if (vectorOps + dataMoves != 0)
+			{
+				llvm::outs() << "\tVector Operators = " << vectorOps << "\n";
+				llvm::outs() << "\t   Data Movement = " << dataMoves << "\n";
+			}
+			if (liveValues != 0)
+			{
+				llvm::outs() << "\t     Live Values = " << liveValues << " in " << asapSteps << " ASAP steps, "
+				             << listLiveValues << " in " << listSteps << " list steps of width " << listWidth << "\n";
+				llvm::outs() << "\t       Live Bits = " << liveBits << " ASAP, " << listLiveBits << " list\n";
+			}
+			if (rawNodeCount != 0)
+			{
+				llvm::outs() << "\t       DAG Nodes = " << rawNodeCount << " (" << nodeCount << " unique)\n";
+				llvm::outs() << "\t     Shared Area = " << rawArea - area << " of " << rawArea << "\n";
+			}
+			if (unknownCalls != 0)
+				llvm::outs() << "\t   Unknown Calls = " << unknownCalls << "\n";
+			if (recursionRounds != 0)
+			{
+				llvm::outs() << "\t       Recursion = " << recursionRounds << " rounds"
+				             << (recursionConverged ? " (converged)\n" : " (bounded)\n");
+			}
 		}
 
 		BaseAnalysisInfo& operator=(const BaseAnalysisInfo &FA) 
@@ -48,10 +222,33 @@ class BaseAnalysisInfo
 			bbCount = FA.bbCount;
 			readCount = FA.readCount;
 			writeCount = FA.writeCount;
+			bytesRead = FA.bytesRead;
+			bytesWritten = FA.bytesWritten;
+			opCount = FA.opCount;
 			varWidth = FA.varWidth;
 			varDepth = FA.varDepth;
 			opWidth = FA.opWidth;
 			opDepth = FA.opDepth;
+			area = FA.area;
+			vectorOps = FA.vectorOps;
+			dataMoves = FA.dataMoves;
+			datapathBits = FA.datapathBits;
+			declaredBits = FA.declaredBits;
+			valueBitWidth = FA.valueBitWidth;
+			opBitWidth = FA.opBitWidth;
+			nodeCount = FA.nodeCount;
+			rawNodeCount = FA.rawNodeCount;
+			rawArea = FA.rawArea;
+			unknownCalls = FA.unknownCalls;
+			recursionRounds = FA.recursionRounds;
+			recursionConverged = FA.recursionConverged;
+			liveValues = FA.liveValues;
+			liveBits = FA.liveBits;
+			listLiveValues = FA.listLiveValues;
+			listLiveBits = FA.listLiveBits;
+			listWidth = FA.listWidth;
+			asapSteps = FA.asapSteps;
+			listSteps = FA.listSteps;
 
 			return *this;
 		}
@@ -65,17 +262,80 @@ class FunctionAnalysisInfo : public BaseAnalysisInfo
 
 	public:
 		FunctionAnalysis_t InnerFA;
+		std::vector<LoopAnalysisInfo> Loops;	//in preorder
+		std::vector<DatapathAnalysisInfo> Datapath;	//unit classes with operators
+		IsomorphicAnalysisInfo Isomorphic;
+		WeightedAnalysisInfo Weighted;
+		std::vector<PathStepInfo> CriticalPath;	//first operator to last, kept for comparisons only
 
 		FunctionAnalysisInfo() : function(nullptr) {}
     	FunctionAnalysisInfo(llvm::Function *function) : function(function) {}
 		~FunctionAnalysisInfo(){}
 
+		llvm::Function* getFunction() const { return function; }
+
+		/// For a result reused by a structurally identical function
+		void setFunction(llvm::Function *function) { this->function = function; }
+
 		void printAnalysis()
 		{
 			if (function!=nullptr)
         llvm::outs() << "\t     Function = " << function->getName() << "()\n";
 			BaseAnalysisInfo::printAnalysis();
 
+			if ( !Weighted.source.empty() )
+			{
+				llvm::outs() << "\t     Weighted By = " << Weighted.source;
+				if (Weighted.calls != 0)
+					llvm::outs() << ", " << Weighted.calls << (Weighted.calls == 1 ? " call" : " calls");
+				llvm::outs() << "\n";
+				llvm::outs() << "\t  Weighted Insts = " << llvm::format("%.6g", Weighted.instCount) << "\n";
+				llvm::outs() << "\t  Weighted Reads = " << llvm::format("%.6g", Weighted.readCount) << "\n";
+				llvm::outs() << "\t Weighted Writes = " << llvm::format("%.6g", Weighted.writeCount) << "\n";
+				if (Weighted.opCount + Weighted.bytes != 0)
+				{
+					llvm::outs() << "\t    Weighted Ops = " << llvm::format("%.6g", Weighted.opCount) << "\n";
+					llvm::outs() << "\t  Weighted Bytes = " << llvm::format("%.6g", Weighted.bytes) << "\n";
+				}
+				if (Weighted.opDepth != 0)
+					llvm::outs() << "\t  Weighted Depth = " << llvm::format("%.6g", Weighted.opDepth) << " cycles\n";
+			}
+
+			for (auto &unit : Datapath)
+			{
+				llvm::outs() << "\t    Unit " << unit.unit << ": " << unit.operators << " ops, "
+				             << unit.bits << " of " << unit.declaredBits << " bits, "
+				             << unit.peakBits << " in flight, area " << unit.area << " of " << unit.declaredArea << "\n";
+			}
+
+			if (Isomorphic.operators != 0)
+			{
+				llvm::outs() << "\tIsomorphic Trees = " << Isomorphic.Groups.size() << " groups, " << Isomorphic.lanes
+				             << " lanes, " << Isomorphic.packedOperators << " of " << Isomorphic.operators << " operators\n";
+				llvm::outs() << "\t      Vectorized = " << Isomorphic.vectorWidth << " wide, " << Isomorphic.vectorDepth
+				             << " deep (" << Isomorphic.scalarWidth << " wide, " << Isomorphic.scalarDepth << " deep scalar)\n";
+				for (auto &group : Isomorphic.Groups)
+				{
+					llvm::outs() << "\t    Group " << group.root << " x" << group.lanes << ": "
+					             << group.operators << " ops, " << group.depth << " deep\n";
+				}
+			}
+
+			for (auto &loop : Loops)
+			{
+				llvm::outs() << "\t    Loop " << (loop.header.empty() ? "<unnamed>" : loop.header)
+				             << " (depth " << loop.depth << "): " << loop.opCount << " ops, "
+				             << loop.bytesRead << " B read, " << loop.bytesWritten << " B written";
+				if (loop.trips != 0)
+				{
+					llvm::outs() << ", " << llvm::format("%.4g", loop.trips) << " trips";
+					if (Weighted.opCount != 0)
+						llvm::outs() << ", " << llvm::format("%.3g", 100 * loop.weightedOps / Weighted.opCount) << "% of weighted ops";
+				}
+				llvm::outs() << "\n";
+				printIntensity(loop.opCount, loop.bytesRead + loop.bytesWritten);
+			}
+
 			if ( !InnerFA.empty() )
 			{
         llvm::outs() << "\t----------------------------------------\n";
@@ -97,6 +357,154 @@ class FunctionAnalysisInfo : public BaseAnalysisInfo
 };
 
 
+/// Prints a metric of two results of a function if it changed
+inline bool printDelta(const char *label, double before, double after)
+{
+	if ( before == after )
+		return false;
+	llvm::outs() << "\t" << llvm::format("%16s", label) << " = " << llvm::format("%.6g", before) << " -> "
+	             << llvm::format("%.6g", after) << " (" << llvm::format("%+.6g", after - before) << ")\n";
+	return true;
+}
+
+/// Prints the metrics that changed between two results of a function (see
+/// runCompare) and returns how many did
+inline unsigned printAnalysisDelta(const FunctionAnalysisInfo &before, const FunctionAnalysisInfo &after)
+{
+	auto &b = before, &a = after;
+	auto &bw = before.Weighted, &aw = after.Weighted;
+	unsigned changed = 0;
+	changed += printDelta("instCount", b.instCount, a.instCount);
+	changed += printDelta("bbCount", b.bbCount, a.bbCount);
+	changed += printDelta("readCount", b.readCount, a.readCount);
+	changed += printDelta("writeCount", b.writeCount, a.writeCount);
+	changed += printDelta("Bytes Read", b.bytesRead, a.bytesRead);
+	changed += printDelta("Bytes Written", b.bytesWritten, a.bytesWritten);
+	changed += printDelta("Operations", b.opCount, a.opCount);
+	changed += printDelta("Variable Width", b.varWidth, a.varWidth);
+	changed += printDelta("Variable Depth", b.varDepth, a.varDepth);
+	changed += printDelta("Operator Width", b.opWidth, a.opWidth);
+	changed += printDelta("Operator Depth", b.opDepth, a.opDepth);
+	changed += printDelta("Operator Area", b.area, a.area);
+	changed += printDelta("Datapath Bits", b.datapathBits, a.datapathBits);
+	changed += printDelta("Declared Bits", b.declaredBits, a.declaredBits);
+	changed += printDelta("Value Bit Width", b.valueBitWidth, a.valueBitWidth);
+	changed += printDelta("Op Bit Width", b.opBitWidth, a.opBitWidth);
+	changed += printDelta("Vector Operators", b.vectorOps, a.vectorOps);
+	changed += printDelta("Data Movement", b.dataMoves, a.dataMoves);
+	changed += printDelta("Live Values", b.liveValues, a.liveValues);
+	changed += printDelta("Live Bits", b.liveBits, a.liveBits);
+	changed += printDelta("List Live Values", b.listLiveValues, a.listLiveValues);
+	changed += printDelta("List Live Bits", b.listLiveBits, a.listLiveBits);
+	changed += printDelta("ASAP Steps", b.asapSteps, a.asapSteps);
+	changed += printDelta("List Steps", b.listSteps, a.listSteps);
+	changed += printDelta("DAG Nodes", b.nodeCount, a.nodeCount);
+	changed += printDelta("Raw DAG Nodes", b.rawNodeCount, a.rawNodeCount);
+	changed += printDelta("Raw Area", b.rawArea, a.rawArea);
+	changed += printDelta("Unknown Calls", b.unknownCalls, a.unknownCalls);
+	changed += printDelta("Recursion", b.recursionRounds, a.recursionRounds);
+	changed += printDelta("Loops", b.Loops.size(), a.Loops.size());
+	changed += printDelta("Weighted Insts", bw.instCount, aw.instCount);
+	changed += printDelta("Weighted Reads", bw.readCount, aw.readCount);
+	changed += printDelta("Weighted Writes", bw.writeCount, aw.writeCount);
+	changed += printDelta("Weighted Ops", bw.opCount, aw.opCount);
+	changed += printDelta("Weighted Bytes", bw.bytes, aw.bytes);
+	changed += printDelta("Weighted Depth", bw.opDepth, aw.opDepth);
+	return changed;
+}
+
+/// Prints the operators of the critical path that were removed (-) and
+/// added (+) between two results of a function: a longest common
+/// subsequence of opcodes and latencies, names may differ. Long paths
+/// that differ everywhere are listed whole.
+inline void printPathDelta(const std::vector<PathStepInfo> &before, const std::vector<PathStepInfo> &after)
+{
+	auto same = [](const PathStepInfo &x, const PathStepInfo &y) {
+		return x.opcode == y.opcode && x.latency == y.latency;
+	};
+	size_t prefix = 0;
+	while ( prefix < before.size() && prefix < after.size() && same(before[prefix], after[prefix]) )
+		prefix++;
+	size_t suffix = 0;
+	while ( suffix < before.size() - prefix && suffix < after.size() - prefix &&
+			same(before[before.size() - 1 - suffix], after[after.size() - 1 - suffix]) )
+		suffix++;
+	size_t n = before.size() - prefix - suffix, m = after.size() - prefix - suffix;
+
+	/// Common[i][j]: longest common subsequence of the middles from i and j
+	std::vector<uint32_t> Common;
+	if ( (n + 1) * (m + 1) <= (1u << 24) )
+	{
+		Common.assign( (n + 1) * (m + 1), 0 );
+		for (size_t i = n; i-- > 0; )
+		{
+			for (size_t j = m; j-- > 0; )
+			{
+				Common[i*(m+1) + j] = same(before[prefix + i], after[prefix + j]) ? Common[(i+1)*(m+1) + j + 1] + 1
+					: std::max(Common[(i+1)*(m+1) + j], Common[i*(m+1) + j + 1]);
+			}
+		}
+	}
+
+	llvm::outs() << "\t   Critical Path = " << before.size() << " -> " << after.size() << " operators, "
+	             << before.size() - n + (Common.empty() ? 0 : Common[0]) << " in common\n";
+	auto printStep = [](char sign, const PathStepInfo &step) {
+		llvm::outs() << "\t\t" << sign << " " << step.opcode;
+		if ( !step.name.empty() )
+			llvm::outs() << " %" << step.name;
+		llvm::outs() << " (" << step.latency << ")\n";
+	};
+	size_t i = 0, j = 0;
+	while ( i < n || j < m )
+	{
+		if ( !Common.empty() && i < n && j < m && same(before[prefix + i], after[prefix + j]) )
+		{
+			i++, j++;
+			continue;
+		}
+		if ( i < n && (j == m || Common.empty() || Common[(i+1)*(m+1) + j] >= Common[i*(m+1) + j + 1]) )
+			printStep('-', before[prefix + i++]);
+		else
+			printStep('+', after[prefix + j++]);
+	}
+}
+
+
+/// Dynamic critical path of one run (see LimitStudy), unbounded and with
+/// a window of in-flight instructions, against the static estimate of the
+/// function that was run
+struct LimitAnalysisInfo
+{
+	std::string entry;
+	uint64_t instructions;	//run, phis not included
+	uint64_t work;			//their summed latency (cycles)
+	std::vector< std::pair<unsigned, uint64_t> > Spans;	//window (0 for none) and span (cycles)
+
+	LimitAnalysisInfo() : instructions(0), work(0) {}
+
+	void printAnalysis(const FunctionAnalysisInfo *FA)
+	{
+		llvm::outs() << "\t     Limit Study = " << entry << "(), " << instructions << " instructions, "
+		             << work << " cycles of work\n";
+		for (auto &span : Spans)
+		{
+			std::string label = span.first == 0 ? "Dynamic Depth" : "Window " + std::to_string(span.first);
+			llvm::outs() << "\t" << llvm::format("%16s", label.c_str()) << " = " << span.second << " cycles";
+			if (span.second != 0)
+				llvm::outs() << ", speedup " << llvm::format("%.3g", (double)work / span.second);
+			llvm::outs() << "\n";
+		}
+		if (FA != nullptr)
+		{
+			llvm::outs() << "\t    Static Depth = " << FA->opDepth << " cycles";
+			if (FA->Weighted.opDepth != 0)
+				llvm::outs() << ", " << llvm::format("%.6g", FA->Weighted.opDepth) << " weighted";
+			llvm::outs() << "\n";
+		}
+	}
+};
+
+
 class ModuleAnalysisInfo : public BaseAnalysisInfo
 {
 	private:
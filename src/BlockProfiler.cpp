@@ -0,0 +1,158 @@
+
+#include <algorithm>
+#include "BlockProfiler.h"
+#include "llvmEstimator.h"
+
+static const char *countsName = "__estimator_block_counts";
+
+
+bool BlockProfiler::run(llvm::Function &entry, const std::string &arguments, BlockProfiles_t &profiles)
+{
+  llvm::ValueToValueMapTy VMap;
+  std::unique_ptr<llvm::Module> clone = llvm::CloneModule(module, VMap);
+  Counters.clear();
+  Buffers.clear();
+  instrument(*clone, VMap);
+  auto wrapper = buildCallWrapper(*clone, *llvm::cast<llvm::Function>( VMap[&entry] ), arguments, Buffers);
+  if ( wrapper == nullptr )
+    return false;
+
+  std::unique_ptr<llvm::ExecutionEngine> engine( buildExecutionEngine(clone) );
+  if ( !engine )
+    return false;
+  engine->runFunction(wrapper, std::vector<llvm::GenericValue>());
+  auto counts = reinterpret_cast<const uint64_t*>( engine->getGlobalValueAddress(countsName) );
+  if ( counts == nullptr )
+  {
+    llvm::errs() << " ERROR: The block counts of " << entry.getName() << "() were not found\n";
+    return false;
+  }
+
+  for (size_t i = 0; i < Counters.size(); ++i)
+  {
+    auto &counter = Counters[i];
+    auto &profile = profiles[counter.function];
+    if ( counter.to != nullptr )
+    {
+      profile.Edges[ std::make_pair(counter.from, counter.to) ] += counts[i];
+      continue;
+    }
+    profile.Blocks[counter.from] += counts[i];
+    if ( counter.from == &counter.function->getEntryBlock() )
+      profile.calls += counts[i];
+
+    //the edges out of a block with one successor run as often as it does
+    auto terminator = counter.from->getTerminator();
+    if ( terminator == nullptr || terminator->getNumSuccessors() == 0 )
+      continue;
+    bool single = true;
+    for (unsigned s = 1; s < terminator->getNumSuccessors(); ++s)
+      single &= terminator->getSuccessor(s) == terminator->getSuccessor(0);
+    if ( single )
+      profile.Edges[ std::make_pair(counter.from, (const llvm::BasicBlock*)terminator->getSuccessor(0)) ] += counts[i];
+  }
+  return true;
+}
+
+
+/// Helper functions
+void BlockProfiler::instrument(llvm::Module &clone, llvm::ValueToValueMapTy &VMap)
+{
+  /// The counters are numbered first, the array is sized by them
+  struct Site
+  {
+    llvm::BasicBlock *block;	//in the clone
+    unsigned counter;
+    llvm::BasicBlock *successor;	//nullptr for a block counter
+  };
+  std::vector<Site> Sites;
+  for (auto &function : module)
+  {
+    if ( function.isDeclaration() )
+      continue;
+    for (auto &BB : function)
+    {
+      auto block = llvm::cast<llvm::BasicBlock>( VMap[&BB] );
+      if ( block->getFirstInsertionPt() == block->end() )
+        continue;
+      Site site = {block, (unsigned)Counters.size(), nullptr};
+      Sites.push_back(site);
+      Counter counter = {&function, &BB, nullptr};
+      Counters.push_back(counter);
+
+      //only branches and switches tell which edge they take
+      auto terminator = BB.getTerminator();
+      if ( !llvm::isa<llvm::BranchInst>(terminator) && !llvm::isa<llvm::SwitchInst>(terminator) )
+        continue;
+      std::vector<llvm::BasicBlock*> successors;
+      for (unsigned s = 0; s < terminator->getNumSuccessors(); ++s)
+      {
+        auto successor = terminator->getSuccessor(s);
+        if ( std::find(successors.begin(), successors.end(), successor) == successors.end() )
+          successors.push_back(successor);
+      }
+      if ( successors.size() < 2 )
+        continue;
+      for (auto successor : successors)
+      {
+        Site edgeSite = {block, (unsigned)Counters.size(), llvm::cast<llvm::BasicBlock>( VMap[successor] )};
+        Sites.push_back(edgeSite);
+        Counter edge = {&function, &BB, successor};
+        Counters.push_back(edge);
+      }
+    }
+  }
+
+  auto &context = clone.getContext();
+  auto countsType = llvm::ArrayType::get( llvm::Type::getInt64Ty(context), Counters.size() );
+  auto counts = new llvm::GlobalVariable(clone, countsType, false, llvm::GlobalValue::ExternalLinkage,
+                                         llvm::ConstantAggregateZero::get(countsType), countsName);
+
+  llvm::IRBuilder<> builder(context);
+  for (auto &site : Sites)
+  {
+    if ( site.successor == nullptr )
+    {
+      builder.SetInsertPoint( &*site.block->getFirstInsertionPt() );
+      addCount(builder, counts, site.counter, builder.getInt64(1));
+      continue;
+    }
+
+    //a switch takes an edge if the condition matches one of its cases,
+    //its default edge if it matches none of the others
+    auto terminator = site.block->getTerminator();
+    builder.SetInsertPoint(terminator);
+    llvm::Value *taken = nullptr;
+    if ( auto branch = llvm::dyn_cast<llvm::BranchInst>(terminator) )
+    {
+      taken = branch->getCondition();
+      if ( branch->getSuccessor(0) != site.successor )
+        taken = builder.CreateNot(taken);
+    }
+    else
+    {
+      auto switchInst = llvm::cast<llvm::SwitchInst>(terminator);
+      bool isDefault = switchInst->getDefaultDest() == site.successor;
+      taken = builder.getFalse();
+      for (auto switchCase : switchInst->cases())
+      {
+        if ( (switchCase.getCaseSuccessor() == site.successor) != isDefault )
+          taken = builder.CreateOr(taken, builder.CreateICmpEQ(switchInst->getCondition(), switchCase.getCaseValue()));
+      }
+      if ( isDefault )
+        taken = builder.CreateNot(taken);
+    }
+    addCount(builder, counts, site.counter, builder.CreateZExt(taken, builder.getInt64Ty()));
+  }
+}
+
+
+void BlockProfiler::addCount(llvm::IRBuilder<> &builder, llvm::GlobalVariable *counts, unsigned counter,
+                             llvm::Value *increment)
+{
+  llvm::Constant *indices[] = {builder.getInt64(0), builder.getInt64(counter)};
+  auto address = llvm::ConstantExpr::getInBoundsGetElementPtr(counts->getValueType(), counts, indices);
+  auto count = builder.CreateLoad(builder.getInt64Ty(), address);
+  builder.CreateStore(builder.CreateAdd(count, increment), address);
+}
+
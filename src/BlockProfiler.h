@@ -0,0 +1,64 @@
+#ifndef BLOCK_PROFILER_H
+#define BLOCK_PROFILER_H
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <LLVMHeaders.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+/// Measured runs of one function's blocks and CFG edges
+struct BlockProfile
+{
+	uint64_t calls;		//runs of the entry block
+	std::unordered_map<const llvm::BasicBlock*, uint64_t> Blocks;
+	std::map<std::pair<const llvm::BasicBlock*, const llvm::BasicBlock*>, uint64_t> Edges;
+
+	BlockProfile() : calls(0) {}
+};
+typedef std::map<const llvm::Function*, BlockProfile> BlockProfiles_t;
+
+
+/**
+ * @brief BlockProfiler
+ * Block and edge counts of one run of a function. Every function with a
+ * body is instrumented in a clone of the module (the analyzed IR does not
+ * change): each block adds one to its counter, and a conditional branch or
+ * a switch adds one to the counter of the edge it takes. Edges out of a
+ * block with one successor count as the block, those of other terminators
+ * (invoke, indirectbr) are not counted. The clone is run under MCJIT from
+ * a wrapper that calls the entry function with constant arguments (see
+ * buildCallWrapper). The entry function runs natively: it must terminate
+ * and must not touch memory outside its buffers.
+ */
+class BlockProfiler
+{
+private:
+	struct Counter
+	{
+		const llvm::Function *function;
+		const llvm::BasicBlock *from;
+		const llvm::BasicBlock *to;		//nullptr for a block counter
+	};
+
+	llvm::Module &module;
+	std::vector<Counter> Counters;
+	std::vector< std::vector<char> > Buffers;
+
+public:
+	BlockProfiler(llvm::Module &module) : module(module) {}
+	~BlockProfiler() {}
+
+	/// Adds the counts of one run of entry to the profiles of every
+	/// function with a body; false (with an error message) if entry
+	/// cannot be run
+	bool run(llvm::Function &entry, const std::string &arguments, BlockProfiles_t &profiles);
+
+private:
+	void instrument(llvm::Module &clone, llvm::ValueToValueMapTy &VMap);
+	void addCount(llvm::IRBuilder<> &builder, llvm::GlobalVariable *counts, unsigned counter,
+	              llvm::Value *increment);
+};
+
+#endif /* BLOCK_PROFILER_H */
@@ -0,0 +1,55 @@
+
+#include <fstream>
+#include <sstream>
+#include "CallSummaries.h"
+
+
+bool CallSummaries::loadFile(std::string fileName)
+{
+  std::ifstream summaryFile(fileName);
+  if ( !summaryFile.is_open() )
+  {
+    llvm::errs() << " ERROR: Call summary file '" << fileName << "' did not open!\n";
+    return false;
+  }
+
+  std::stringstream text;
+  text << summaryFile.rdbuf();
+  return parse(text.str(), fileName);
+}
+
+/// Helper functions
+bool CallSummaries::parse(std::string text, std::string source)
+{
+  std::istringstream lines(text);
+  std::string line;
+  int lineNumber = 0;
+
+  while ( std::getline(lines, line) )
+  {
+    lineNumber++;
+    line = line.substr( 0, line.find('#') );
+
+    std::istringstream fields(line);
+    std::string name;
+    if ( !(fields >> name) )
+      continue; // blank or comment line
+
+    CallCost cost;
+    if ( !(fields >> cost.latency >> cost.area) || cost.latency < 0 || cost.area < 0 )
+    {
+      llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": expected "
+                   << "<name|prefix*|*> <latency> <area>\n";
+      return false;
+    }
+
+    if ( name == "*" )
+      unknownCost = cost;
+    else if ( name.back() == '*' )
+      Prefixes[ name.substr(0, name.size()-1) ] = cost;
+    else
+      Names[name] = cost;
+  }
+
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CALL_SUMMARIES_H
+#define CALL_SUMMARIES_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <LLVMHeaders.h>
+
+/// Latency (cycles) and area of a call whose callee is not analyzed
+struct CallCost
+{
+	int latency;
+	int area;
+};
+
+/**
+ * @brief CallSummaries
+ * Costs of calls into functions without a body (library functions,
+ * intrinsics) and of calls whose callee is unknown (indirect calls, inline
+ * assembly, declarations missing from the table).
+ *
+ * Summary files hold one entry per line:
+ *   <name|prefix*|*> <latency> <area>
+ * A name ending in '*' matches every function starting with the prefix
+ * (the longest prefix wins, an exact name wins over any prefix) and '*'
+ * alone sets the cost of unknown calls.
+ */
+class CallSummaries
+{
+private:
+	std::map<std::string, CallCost> Names;
+	std::map<std::string, CallCost> Prefixes;
+	CallCost unknownCost;
+
+public:
+	CallSummaries() { unknownCost.latency = 0; unknownCost.area = 0; }
+	~CallSummaries() {}
+
+	const CallCost& getUnknownCost() const { return unknownCost; }
+	void setUnknownCost(CallCost cost) { unknownCost = cost; }
+
+	/// Cost of a declaration named name, nullptr if no entry matches
+	const CallCost* lookup(llvm::StringRef name) const
+	{
+		auto exact = Names.find( name.str() );
+		if ( exact != Names.end() )
+			return &exact->second;
+
+		// the longest matching prefix is the last one in sorted order
+		// among those that match
+		const CallCost *best = nullptr;
+		for (auto &prefix : Prefixes)
+		{
+			if ( name.startswith(prefix.first) )
+				best = &prefix.second;
+		}
+		return best;
+	}
+
+	bool loadFile(std::string fileName);
+
+private:
+	bool parse(std::string text, std::string source);
+};
+
+#endif /* CALL_SUMMARIES_H */
@@ -0,0 +1,355 @@
+
+#include <fstream>
+#include <sstream>
+#include "CostModel.h"
+
+/// Built-in cost tables. Each family is written in the cost file format
+/// so that user files and defaults go through the same parser.
+static const char *GenericCosts =
+  "*              *     *   1    1     alu\n"
+  "alloca         *     *   0    0     none\n"
+  "phi            *     *   0    1     move\n"
+  "bitcast        *     *   0    0     none\n"
+  "ptrtoint       *     *   0    0     none\n"
+  "inttoptr       *     *   0    0     none\n"
+  "trunc          *     *   0    0     conv\n"
+  "zext           *     *   0    0     conv\n"
+  "sext           *     *   0    1     conv\n"
+  "mul            int   *   3    4     mul\n"
+  "udiv           int   *   16   16    div\n"
+  "sdiv           int   *   16   16    div\n"
+  "urem           int   *   16   16    div\n"
+  "srem           int   *   16   16    div\n"
+  "fadd           *     *   4    8     fpu\n"
+  "fsub           *     *   4    8     fpu\n"
+  "fmul           *     *   4    8     fpu\n"
+  "fdiv           *     *   16   24    div\n"
+  "frem           *     *   16   24    div\n"
+  "fcmp           *     *   2    4     fpu\n"
+  "fptosi         *     *   4    4     conv\n"
+  "fptoui         *     *   4    4     conv\n"
+  "sitofp         *     *   4    4     conv\n"
+  "uitofp         *     *   4    4     conv\n"
+  "fptrunc        *     *   2    2     conv\n"
+  "fpext          *     *   2    2     conv\n"
+  "load           *     *   2    1     mem\n"
+  "store          *     *   1    1     mem\n"
+  "getelementptr  *     *   1    1     alu\n"
+  "extractelement *     *   1    1     move\n"
+  "insertelement  *     *   1    1     move\n"
+  "shufflevector  *     *   1    1     move\n"
+  "extractvalue   *     *   0    0     move\n"
+  "insertvalue    *     *   0    0     move\n"
+  "select         *     *   1    1     move\n"
+  "br             *     *   1    0     ctrl\n"
+  "switch         *     *   1    1     ctrl\n"
+  "ret            *     *   0    0     ctrl\n"
+  "call           *     *   1    0     call\n";
+
+static const char *XilinxUltrascaleCosts =
+  "family generic\n"
+  "add            int   64  2    64    alu\n"
+  "sub            int   64  2    64    alu\n"
+  "mul            int   8   1    1     mul\n"
+  "mul            int   16  2    1     mul\n"
+  "mul            int   32  3    3     mul\n"
+  "mul            int   64  6    10    mul\n"
+  "udiv           int   32  36   1100  div\n"
+  "sdiv           int   32  36   1150  div\n"
+  "udiv           int   64  68   4200  div\n"
+  "sdiv           int   64  68   4300  div\n"
+  "urem           int   32  36   1100  div\n"
+  "srem           int   32  36   1150  div\n"
+  "fadd           fp    32  8    360   fpu\n"
+  "fsub           fp    32  8    360   fpu\n"
+  "fmul           fp    32  6    110   fpu\n"
+  "fdiv           fp    32  28   800   div\n"
+  "fadd           fp    64  11   700   fpu\n"
+  "fsub           fp    64  11   700   fpu\n"
+  "fmul           fp    64  13   300   fpu\n"
+  "fdiv           fp    64  57   3200  div\n"
+  "load           *     *   2    0     mem\n"
+  "store          *     *   1    0     mem\n";
+
+static const char *IntelStratix10Costs =
+  "family generic\n"
+  "mul            int   16  2    1     mul\n"
+  "mul            int   32  3    2     mul\n"
+  "mul            int   64  5    8     mul\n"
+  "udiv           int   32  32   900   div\n"
+  "sdiv           int   32  32   950   div\n"
+  "udiv           int   64  64   3800  div\n"
+  "sdiv           int   64  64   3900  div\n"
+  "fadd           fp    32  3    1     fpu\n"
+  "fsub           fp    32  3    1     fpu\n"
+  "fmul           fp    32  3    1     fpu\n"
+  "fdiv           fp    32  20   700   div\n"
+  "fadd           fp    64  12   900   fpu\n"
+  "fsub           fp    64  12   900   fpu\n"
+  "fmul           fp    64  10   400   fpu\n"
+  "fdiv           fp    64  48   2900  div\n"
+  "load           *     *   3    0     mem\n"
+  "store          *     *   1    0     mem\n";
+
+static const char *LatticeECP5Costs =
+  "family generic\n"
+  "add            int   32  2    32    alu\n"
+  "add            int   64  3    64    alu\n"
+  "sub            int   32  2    32    alu\n"
+  "sub            int   64  3    64    alu\n"
+  "mul            int   32  4    4     mul\n"
+  "mul            int   64  8    16    mul\n"
+  "udiv           int   32  40   1300  div\n"
+  "sdiv           int   32  40   1350  div\n"
+  "fadd           fp    32  10   450   fpu\n"
+  "fsub           fp    32  10   450   fpu\n"
+  "fmul           fp    32  8    300   fpu\n"
+  "fdiv           fp    32  32   1000  div\n"
+  "fadd           fp    64  16   1100  fpu\n"
+  "fsub           fp    64  16   1100  fpu\n"
+  "fmul           fp    64  18   1400  fpu\n"
+  "fdiv           fp    64  64   4500  div\n"
+  "load           *     *   2    0     mem\n"
+  "store          *     *   1    0     mem\n";
+
+
+bool CostModel::loadFamily(std::string familyName)
+{
+  const char *costs = nullptr;
+  if ( familyName == "generic" )
+    costs = GenericCosts;
+  else if ( familyName == "xilinx-ultrascale" )
+    costs = XilinxUltrascaleCosts;
+  else if ( familyName == "intel-stratix10" )
+    costs = IntelStratix10Costs;
+  else if ( familyName == "lattice-ecp5" )
+    costs = LatticeECP5Costs;
+  else
+  {
+    llvm::errs() << " ERROR: Unknown FPGA family '" << familyName << "'"
+                 << " (expected generic, xilinx-ultrascale, intel-stratix10 or lattice-ecp5)\n";
+    return false;
+  }
+
+  if ( !parse(costs, familyName) )
+    return false;
+  family = familyName;
+  return true;
+}
+
+bool CostModel::loadFile(std::string fileName)
+{
+  std::ifstream costFile(fileName);
+  if ( !costFile.is_open() )
+  {
+    llvm::errs() << " ERROR: Cost model file '" << fileName << "' did not open!\n";
+    return false;
+  }
+
+  std::stringstream text;
+  text << costFile.rdbuf();
+  if ( !parse(text.str(), fileName) )
+    return false;
+  family = fileName;
+  return true;
+}
+
+const CostModel& CostModel::getDefault()
+{
+  static const CostModel defaultModel;
+  return defaultModel;
+}
+
+unsigned CostModel::getScalarBits(const llvm::Value *value, bool narrow)
+{
+  auto scalarTy = value->getType()->getScalarType();
+  if ( scalarTy->isPointerTy() )
+    return 64;
+  unsigned bits = scalarTy->getPrimitiveSizeInBits();
+  if ( !narrow || !scalarTy->isIntegerTy() || bits <= 1 )
+    return bits;
+
+  // known bits need the data layout of the module the value lives in
+  const llvm::Module *module = nullptr;
+  if ( auto inst = llvm::dyn_cast<llvm::Instruction>(value) )
+    module = inst->getModule();
+  else if ( auto arg = llvm::dyn_cast<llvm::Argument>(value) )
+    module = arg->getParent()->getParent();
+  else if ( auto CI = llvm::dyn_cast<llvm::ConstantInt>(value) )
+    return std::max(1u, std::min(CI->getValue().getActiveBits(), CI->getValue().getMinSignedBits()));
+  if ( module == nullptr )
+    return bits;
+
+  // the narrower of the unsigned (leading zeros) and signed (sign bits)
+  // representations, at least one bit
+  auto &DL = module->getDataLayout();
+  auto known = llvm::computeKnownBits(value, DL);
+  unsigned unsignedBits = bits - known.countMinLeadingZeros();
+  unsigned signedBits = bits - llvm::ComputeNumSignBits(value, DL) + 1;
+  return std::max(1u, std::min(unsignedBits, signedBits));
+}
+
+unsigned CostModel::getDatapathBits(const llvm::Instruction *inst, bool narrow)
+{
+  if ( auto store = llvm::dyn_cast<llvm::StoreInst>(inst) )
+    return getScalarBits(store->getValueOperand(), narrow);
+
+  unsigned bits = inst->getType()->isVoidTy() ? 0 : getScalarBits(inst, narrow);
+  bool wideOperands = llvm::isa<llvm::CmpInst>(inst) ||
+                      ( llvm::isa<llvm::CastInst>(inst) && !llvm::isa<llvm::TruncInst>(inst) );
+  switch ( inst->getOpcode() ) {
+    case llvm::Instruction::UDiv: case llvm::Instruction::SDiv:
+    case llvm::Instruction::URem: case llvm::Instruction::SRem:
+    case llvm::Instruction::LShr: case llvm::Instruction::AShr:
+      wideOperands = true;
+      break;
+    default:
+      break;
+  }
+  if ( wideOperands )
+  {
+    for (auto &operand : inst->operands())
+      bits = std::max(bits, getScalarBits(operand.get(), narrow));
+  }
+  return bits;
+}
+
+unit_t CostModel::getUnitClass(std::string unitName)
+{
+  for (int unit = NO_UNIT; unit < UNIT_COUNT; ++unit)
+  {
+    if ( getUnitName((unit_t)unit) == unitName )
+      return (unit_t)unit;
+  }
+  return UNIT_COUNT;
+}
+
+std::string CostModel::getUnitName(unit_t unit)
+{
+  switch ( unit ) {
+    case (NO_UNIT): return "none";
+    case (ALU):     return "alu";
+    case (MUL):     return "mul";
+    case (DIV):     return "div";
+    case (FPU):     return "fpu";
+    case (MEM):     return "mem";
+    case (CONV):    return "conv";
+    case (MOVE):    return "move";
+    case (CTRL):    return "ctrl";
+    case (CALL):    return "call";
+    default:        return "<invalid unit>";
+  }
+}
+
+/// Helper functions
+bool CostModel::parse(std::string text, std::string source)
+{
+  std::istringstream lines(text);
+  std::string line;
+  int lineNumber = 0;
+
+  while ( std::getline(lines, line) )
+  {
+    lineNumber++;
+    line = line.substr( 0, line.find('#') );
+
+    std::istringstream fields(line);
+    std::string opcodeName, typeName, widthName, unitName;
+    if ( !(fields >> opcodeName) )
+      continue; // blank or comment line
+
+    if ( opcodeName == "family" )
+    {
+      std::string baseFamily;
+      if ( !(fields >> baseFamily) || !loadFamily(baseFamily) )
+      {
+        llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": bad family line\n";
+        return false;
+      }
+      continue;
+    }
+
+    OpCost cost;
+    if ( !(fields >> typeName >> widthName >> cost.latency >> cost.area >> unitName) )
+    {
+      llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": expected "
+                   << "<opcode> <type> <bits> <latency> <area> <unit>\n";
+      return false;
+    }
+
+    // resolve each field, -1 is a wildcard
+    int opcode = -1;
+    if ( opcodeName != "*" )
+    {
+      for (unsigned op = 1; op < OpcodeCount; ++op)
+      {
+        if ( opcodeName == llvm::Instruction::getOpcodeName(op) )
+          opcode = op;
+      }
+      if ( opcode == -1 )
+      {
+        llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": unknown opcode '" << opcodeName << "'\n";
+        return false;
+      }
+    }
+
+    int typeClass = -1;
+    if ( typeName == "int" )
+      typeClass = INT_TY;
+    else if ( typeName == "fp" )
+      typeClass = FP_TY;
+    else if ( typeName == "ptr" )
+      typeClass = PTR_TY;
+    else if ( typeName == "other" )
+      typeClass = OTHER_TY;
+    else if ( typeName != "*" )
+    {
+      llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": unknown type class '" << typeName << "'\n";
+      return false;
+    }
+
+    int widthBucket = -1;
+    if ( widthName != "*" )
+    {
+      unsigned bits = 0;
+      std::istringstream widthField(widthName);
+      if ( !(widthField >> bits) )
+      {
+        llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": bad bit width '" << widthName << "'\n";
+        return false;
+      }
+      widthBucket = getWidthBucket(bits);
+    }
+
+    cost.unit = getUnitClass(unitName);
+    if ( cost.unit == UNIT_COUNT )
+    {
+      llvm::errs() << " ERROR: " << source << ":" << lineNumber << ": unknown unit class '" << unitName << "'\n";
+      return false;
+    }
+
+    set(opcode, typeClass, widthBucket, cost);
+  }
+
+  return true;
+}
+
+void CostModel::set(int opcode, int typeClass, int widthBucket, OpCost cost)
+{
+  for (unsigned op = 0; op < OpcodeCount; ++op)
+  {
+    if ( opcode != -1 && (unsigned)opcode != op )
+      continue;
+    for (unsigned ty = 0; ty < TYPE_CLASS_COUNT; ++ty)
+    {
+      if ( typeClass != -1 && (unsigned)typeClass != ty )
+        continue;
+      for (unsigned bucket = 0; bucket < WidthBucketCount; ++bucket)
+      {
+        if ( widthBucket != -1 && (unsigned)widthBucket != bucket )
+          continue;
+        Table[op][ty][bucket] = cost;
+      }
+    }
+  }
+}
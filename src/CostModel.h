@@ -0,0 +1,150 @@
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+
+#include <string>
+#include <LLVMHeaders.h>
+
+typedef enum unit_t{NO_UNIT, ALU, MUL, DIV, FPU, MEM, CONV, MOVE, CTRL, CALL, UNIT_COUNT} unit_t;
+typedef enum typeClass_t{INT_TY, FP_TY, PTR_TY, OTHER_TY, TYPE_CLASS_COUNT} typeClass_t;
+
+/// Latency (cycles) and area (LUT equivalents) of one operator
+struct OpCost
+{
+	int latency;
+	int area;
+	unit_t unit;
+};
+
+/**
+ * @brief CostModel
+ * Maps (opcode, type class, bit width) to an operator cost. Every cost is
+ * resolved once into a dense table indexed by opcode so that a lookup
+ * during DAG construction or traversal is a single array access.
+ *
+ * Cost files hold one rule per line, applied in order (later rules win):
+ *   family <name>                                  (start from a built-in family)
+ *   <opcode|*> <int|fp|ptr|other|*> <bits|*> <latency> <area> <unit>
+ */
+class CostModel
+{
+private:
+	static const unsigned OpcodeCount = llvm::Instruction::OtherOpsEnd;
+	static const unsigned WidthBucketCount = 6; // 1, 8, 16, 32, 64, >64 bits
+
+	OpCost Table[OpcodeCount][TYPE_CLASS_COUNT][WidthBucketCount];
+	std::string family;
+
+public:
+	CostModel() { loadFamily("generic"); }
+	~CostModel() {}
+
+	std::string getFamily() const { return family; }
+
+	const OpCost& lookup(unsigned opcode, llvm::Type *type) const
+	{
+		if ( opcode >= OpcodeCount )
+			opcode = 0;
+		return Table[opcode][getTypeClass(type)][getWidthBucket(type)];
+	}
+
+	const OpCost& lookup(const llvm::Instruction *inst) const
+	{
+		// stores and compares are costed by their operand type,
+		// everything else by the type it produces
+		llvm::Type *type = inst->getType();
+		if ( llvm::isa<llvm::StoreInst>(inst) || llvm::isa<llvm::CmpInst>(inst) )
+			type = inst->getOperand(0)->getType();
+		return lookup(inst->getOpcode(), type);
+	}
+
+	/// Cost of an instruction whose datapath is only bits wide
+	const OpCost& lookup(const llvm::Instruction *inst, unsigned bits) const
+	{
+		llvm::Type *type = inst->getType();
+		if ( llvm::isa<llvm::StoreInst>(inst) || llvm::isa<llvm::CmpInst>(inst) )
+			type = inst->getOperand(0)->getType();
+		unsigned opcode = inst->getOpcode() < OpcodeCount ? inst->getOpcode() : 0;
+		return Table[opcode][getTypeClass(type)][getWidthBucket(bits)];
+	}
+
+	bool loadFamily(std::string familyName);
+	bool loadFile(std::string fileName);
+
+	static const CostModel& getDefault();
+
+	/// Bits a value of the type occupies: pointers are 64 bits, aggregates
+	/// the sum of their elements
+	static uint64_t getBitWidth(llvm::Type *type)
+	{
+		if ( type->isPointerTy() )
+			return 64;
+		if ( auto structTy = llvm::dyn_cast<llvm::StructType>(type) )
+		{
+			uint64_t bits = 0;
+			for (auto element : structTy->elements())
+				bits += getBitWidth(element);
+			return bits;
+		}
+		if ( auto arrayTy = llvm::dyn_cast<llvm::ArrayType>(type) )
+			return arrayTy->getNumElements() * getBitWidth( arrayTy->getElementType() );
+		if ( type->isVectorTy() && type->getScalarType()->isPointerTy() )
+			return getLaneCount(type) * 64;
+		return type->getPrimitiveSizeInBits();
+	}
+
+	/// Elements of a vector type, 1 for a scalar
+	static unsigned getLaneCount(llvm::Type *type)
+	{
+		return type->isVectorTy() ? type->getVectorNumElements() : 1;
+	}
+
+	/// Bits of one element of the value (pointers are 64 bits, void 0).
+	/// Narrowed, an integer keeps only the bits that known-bits analysis
+	/// cannot prove to be zero or copies of the sign bit.
+	static unsigned getScalarBits(const llvm::Value *value, bool narrow);
+
+	/// Bits of one lane of an operator's datapath: its result, the value
+	/// stored, or the widest operand of a compare and of the operators
+	/// whose result bits depend on the high bits of their operands
+	/// (divisions, remainders, right shifts and casts other than trunc)
+	static unsigned getDatapathBits(const llvm::Instruction *inst, bool narrow);
+
+	static unit_t getUnitClass(std::string unitName);
+	static std::string getUnitName(unit_t unit);
+
+private:
+	bool parse(std::string text, std::string source);
+	void set(int opcode, int typeClass, int widthBucket, OpCost cost);
+
+	static unsigned getTypeClass(llvm::Type *type)
+	{
+		auto scalarTy = type->getScalarType();
+		if ( scalarTy->isIntegerTy() )
+			return INT_TY;
+		if ( scalarTy->isFloatingPointTy() )
+			return FP_TY;
+		if ( scalarTy->isPointerTy() )
+			return PTR_TY;
+		return OTHER_TY;
+	}
+
+	static unsigned getWidthBucket(unsigned bits)
+	{
+		if ( bits <= 1 )  return 0;
+		if ( bits <= 8 )  return 1;
+		if ( bits <= 16 ) return 2;
+		if ( bits <= 32 ) return 3;
+		if ( bits <= 64 ) return 4;
+		return 5;
+	}
+
+	static unsigned getWidthBucket(llvm::Type *type)
+	{
+		auto scalarTy = type->getScalarType();
+		if ( scalarTy->isPointerTy() )
+			return getWidthBucket(64);
+		return getWidthBucket( scalarTy->getPrimitiveSizeInBits() );
+	}
+};
+
+#endif /* COST_MODEL_H */
@@ -3,10 +3,44 @@
 
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 // #include "DGBuilder.h"
+#include "DAGFile.h"
 #include "DAGNode.h"
+#include "DAGSummary.h"
+#include "DOTWriter.h"
+#include "SVGRenderer.h"
+#include "DAGTraversal.h"
+#include "IsomorphicGroups.h"
+#include "LiveRanges.h"
 #include "FunctionInfoPass.h"
+#include "VisitMarks.h"
+#include "WorkerPool.h"
+
+
+/// Results of a schedule of the locked DAG. Depths are measured along the
+/// dependence edges; the operator metrics are weighted by the cost model.
+struct DAGSchedule
+{
+	int height;		//nodes on the longest path
+	int width;		//most value lanes on a single ASAP level
+	int latency;	//weighted critical path (cycles)
+	int opWidth;	//peak operator lanes in flight in the weighted ASAP schedule
+	int area;		//total operator area
+	int vectorOps;	//operators on vectors
+	int moves;		//vector data movement (shuffles, extracts, inserts)
+};
+
+/// Bits of the datapath of the locked, scheduled DAG, each node counted
+/// as its lanes times the bits of one lane
+struct DatapathProfile
+{
+	uint64_t valueBits;		//most value bits on a single ASAP level
+	uint64_t operatorBits;	//peak operator bits in flight in the weighted ASAP schedule
+	std::vector<DatapathAnalysisInfo> Classes;	//by unit_t
+};
 
 
 class DAGBuilder 
@@ -15,12 +49,20 @@ private:
 	// DGBuilder *DG_Builder; //dependence graph builder
 	DAGVertexList Vertices;
 	DAGValueList VertexByValue;
+	std::vector<DAGNode*> NodeByID; //dense IDs, filled by lock()
+	std::vector<int> Level, Finish, After; //by node ID, filled by findSchedule()
+	std::vector<unsigned> LevelOrder; //node IDs grouped by level
+	std::vector<size_t> LevelStart; //LevelOrder index of each level's first node
+	std::unordered_set<llvm::Value*> Expanded; //instructions whose operands are linked
+	const CostModel *costModel;
+	llvm::DominatorTree *DT;
 	bool hasBeenInitialized;
 	bool DAGIsLocked;
 
 
 public:
-	DAGBuilder() : hasBeenInitialized(false){}
+	DAGBuilder(const CostModel *costModel=nullptr) : 
+		costModel(costModel ? costModel : &CostModel::getDefault()), DT(nullptr), hasBeenInitialized(false), DAGIsLocked(false){}
 	~DAGBuilder() {}
 
 	DAGVertexList retrieveDAG() 
@@ -29,16 +71,295 @@ public:
 		return Vertices;
 	}
 
-	void lock() { DAGIsLocked = true; }
+	/// Freezes the DAG and numbers its nodes densely so that traversals can
+	/// keep their state in arrays (see VisitMarks) instead of in the nodes
+	void lock()
+	{
+		NodeByID.clear();
+		NodeByID.reserve( Vertices.size() );
+		for (auto vertex_pair : Vertices)
+		{
+			vertex_pair.second->setID( NodeByID.size() );
+			NodeByID.push_back(vertex_pair.second);
+		}
+		DAGIsLocked = true;
+	}
+
+	size_t getNodeCount() { return NodeByID.size(); }
+	std::vector<DAGNode*>& getNodes() { return NodeByID; }
+
+	/// ASAP level and finish time (cycles) of each node ID, from the
+	/// last findSchedule()
+	std::vector<int>& getLevels() { return Level; }
+	std::vector<int>& getFinishTimes() { return Finish; }
+
+	/// Longest path (cycles) of the nodes depending on each node ID; a node
+	/// with Finish + After equal to the schedule latency is critical
+	std::vector<int>& getPathsAfter() { return After; }
+
+	/// Node IDs of level l are LevelOrder[LevelStart[l] .. LevelStart[l+1])
+	std::vector<unsigned>& getLevelOrder() { return LevelOrder; }
+	std::vector<size_t>& getLevelStart() { return LevelStart; }
 	// DGBuilder* getDGBuilder() 
 	// { 
 	// 	assert( DG_Builder != nullptr && "DGBuilder has not been set. Use createDG()");
 	// 	return DG_Builder;
 	// }
 
+	/// Memory dependences from MemorySSA. A load (or a call that only reads
+	/// memory) depends on the write that clobbers its location and a store
+	/// on the previous write to its location; writes through other calls
+	/// are kept in order. Loop-carried dependences are left out like
+	/// loop-carried phi operands.
+	void addMemoryDependences(llvm::Function &function, llvm::MemorySSA &MSSA)
+	{
+		assert( hasBeenInitialized && "Builder has not been initialized! Do so with init()");
+		auto walker = MSSA.getWalker();
+
+		for (auto blockIter=function.begin(); blockIter!=function.end(); ++blockIter)
+		{
+			for (auto instIter=blockIter->begin(); instIter!=blockIter->end(); ++instIter)
+			{
+				llvm::Instruction *inst = &*instIter;
+				auto access = MSSA.getMemoryAccess(inst);
+				if ( access == nullptr || !isValuePresent(inst) )
+					continue;
+				DAGNode *instNode = VertexByValue[inst];
+				std::unordered_set<llvm::MemoryAccess*> visitedPhis;
+
+				if ( llvm::isa<llvm::LoadInst>(inst) )
+				{
+					auto location = llvm::MemoryLocation::get( llvm::cast<llvm::LoadInst>(inst) );
+					addMemoryDependence(instNode, inst, walker->getClobberingMemoryAccess(access),
+										&location, MSSA, visitedPhis);
+				}
+				else if ( llvm::isa<llvm::MemoryUse>(access) )
+				{
+					addMemoryDependence(instNode, inst, walker->getClobberingMemoryAccess(access),
+										nullptr, MSSA, visitedPhis);
+				}
+				else if ( llvm::isa<llvm::StoreInst>(inst) || llvm::isa<llvm::MemIntrinsic>(inst) )
+				{
+					auto location = llvm::isa<llvm::StoreInst>(inst) ?
+						llvm::MemoryLocation::get( llvm::cast<llvm::StoreInst>(inst) ) :
+						llvm::MemoryLocation::getForDest( llvm::cast<llvm::MemIntrinsic>(inst) );
+					auto previous = llvm::cast<llvm::MemoryUseOrDef>(access)->getDefiningAccess();
+					addMemoryDependence(instNode, inst, walker->getClobberingMemoryAccess(previous, location),
+										&location, MSSA, visitedPhis);
+				}
+				else if ( llvm::isa<llvm::MemoryDef>(access) )
+				{
+					auto previous = llvm::cast<llvm::MemoryUseOrDef>(access)->getDefiningAccess();
+					addMemoryDependence(instNode, inst, previous, nullptr, MSSA, visitedPhis);
+				}
+			}
+		}
+	}
+
+	/// Stitch fragments built over disjoint sets of blocks into this
+	/// builder. A value keeps the node built by the fragment that holds its
+	/// defining block, shared values (constants, arguments, allocas) the
+	/// node of the first fragment that used them. Other fragments'
+	/// placeholders are folded into that node and their edges are rewired,
+	/// which adds the data edges across fragments. Every fragment only
+	/// reads the others' value index, so the merge runs on the pool; the
+	/// owners depend on fragment order alone so the result is the same for
+	/// any thread count.
+	void stitch(std::vector<DAGBuilder*> &fragments,
+				std::unordered_map<const llvm::BasicBlock*, unsigned> &FragmentOf,
+				WorkerPool &pool)
+	{
+		assert( hasBeenInitialized && "Builder has not been initialized! Do so with init()");
+		typedef std::pair<const llvm::Value*, vertex_t> NodeKey;
+		typedef std::pair<DAGNode*, unsigned> Owner; //node and its fragment
+		typedef std::pair<DAGNode*, DAGNode*> Edge;
+		size_t fragmentCount = fragments.size();
+
+		// shared values go to the first fragment, in fragment order
+		std::map<NodeKey, Owner> SharedOwners;
+		for (size_t i = 0; i < fragmentCount; ++i)
+		{
+			for (auto value_pair : fragments[i]->VertexByValue)
+			{
+				if ( isBlockLocal(value_pair.first) )
+					continue;
+				auto node = value_pair.second;
+				SharedOwners.insert( std::make_pair(NodeKey(value_pair.first, node->getType()), Owner(node, i)) );
+			}
+		}
+
+		// resolve each fragment's nodes to their owners
+		std::vector< std::unordered_map<DAGNode*, Owner> > Resolved(fragmentCount);
+		pool.parallelFor(fragmentCount, [&](size_t i) {
+			for (auto vertex_pair : fragments[i]->Vertices)
+			{
+				auto node = vertex_pair.second;
+				auto value = node->getllvmValue();
+				Owner owner(node, i);
+				if ( isBlockLocal(value) )
+				{
+					auto home = FragmentOf.find( llvm::cast<llvm::Instruction>(value)->getParent() );
+					DAGNode *homeNode = nullptr;
+					if ( home != FragmentOf.end() )
+						homeNode = fragments[home->second]->findVertex(value, node->getType());
+					if ( homeNode != nullptr )
+						owner = Owner(homeNode, home->second);
+				}
+				else
+				{
+					auto shared = SharedOwners.find( NodeKey(value, node->getType()) );
+					if ( shared != SharedOwners.end() )
+						owner = shared->second;
+				}
+				Resolved[i][node] = owner;
+			}
+		});
+
+		// rewire every edge onto the owning nodes; an edge is bucketed by the
+		// fragments owning its ends so each fragment adds its own adjacency
+		std::vector< std::vector< std::vector<Edge> > > Outgoing(fragmentCount,
+			std::vector< std::vector<Edge> >(fragmentCount));
+		std::vector< std::vector< std::vector<Edge> > > Incoming(fragmentCount,
+			std::vector< std::vector<Edge> >(fragmentCount));
+		pool.parallelFor(fragmentCount, [&](size_t i) {
+			auto &resolved = Resolved[i];
+			for (auto vertex_pair : fragments[i]->Vertices)
+			{
+				auto node = vertex_pair.second;
+				auto from = resolved[node];
+				for (auto successor_pair : node->getSuccessors())
+				{
+					auto to = resolved[successor_pair.second];
+					if ( from.first == to.first )
+						continue;
+					Outgoing[i][from.second].push_back( Edge(from.first, to.first) );
+					Incoming[i][to.second].push_back( Edge(from.first, to.first) );
+				}
+			}
+			for (auto vertex_pair : fragments[i]->Vertices)
+				vertex_pair.second->clearEdges();
+		});
+		pool.parallelFor(fragmentCount, [&](size_t k) {
+			for (size_t i = 0; i < fragmentCount; ++i)
+			{
+				for (auto edge : Outgoing[i][k])
+					edge.first->addSuccessor(edge.second);
+				for (auto edge : Incoming[i][k])
+					edge.second->addPredecessor(edge.first);
+			}
+		});
+
+		// keep the owners, drop the folded placeholders
+		for (size_t i = 0; i < fragmentCount; ++i)
+		{
+			auto &resolved = Resolved[i];
+			for (auto vertex_pair : fragments[i]->Vertices)
+			{
+				auto node = vertex_pair.second;
+				if ( resolved[node].first != node )
+				{
+					delete node;
+					continue;
+				}
+				if ( node->getValueNode() != nullptr )
+					node->setValueNode( resolved[node->getValueNode()].first );
+
+				auto value = const_cast<llvm::Value*>(node->getllvmValue());
+				Vertices[node] = node;
+				if ( node->getType() != VAL || !isValuePresent(value) )
+					VertexByValue[value] = node;
+			}
+			Expanded.insert( fragments[i]->Expanded.begin(), fragments[i]->Expanded.end() );
+			fragments[i]->Vertices.clear();
+			fragments[i]->VertexByValue.clear();
+		}
+	}
+
+	/// Control dependences from the post-dominator tree: a block depends on
+	/// the branch ending A when it post-dominates a successor of A but not A
+	/// itself. Operations without side effects may run speculatively (as
+	/// after if-conversion), so only stores, calls and returns in a block
+	/// depend on its branches; a phi depends on the branches that choose
+	/// its incoming edge. Loop-carried control dependences are left out.
+	void addControlDependences(llvm::Function &function, llvm::PostDominatorTree &PDT)
+	{
+		assert( hasBeenInitialized && "Builder has not been initialized! Do so with init()");
+		std::map< llvm::BasicBlock*, std::vector<llvm::Instruction*> > Controllers;
+
+		for (auto blockIter=function.begin(); blockIter!=function.end(); ++blockIter)
+		{
+			llvm::BasicBlock *BB = &*blockIter;
+			auto branch = BB->getTerminator();
+			auto BBNode = PDT.getNode(BB);
+			if ( branch == nullptr || branch->getNumSuccessors() < 2 || BBNode == nullptr )
+				continue;
+			auto ipdom = BBNode->getIDom() ? BBNode->getIDom()->getBlock() : nullptr;
+
+			for (unsigned i = 0; i < branch->getNumSuccessors(); ++i)
+			{
+				auto runner = branch->getSuccessor(i);
+				while ( runner != nullptr && runner != ipdom )
+				{
+					if ( DT && DT->dominates(runner, BB) )
+						break;
+					auto &branches = Controllers[runner];
+					if ( branches.empty() || branches.back() != branch )
+						branches.push_back(branch);
+					auto runnerNode = PDT.getNode(runner);
+					runner = (runnerNode && runnerNode->getIDom()) ? runnerNode->getIDom()->getBlock() : nullptr;
+				}
+			}
+		}
+
+		for (auto blockIter=function.begin(); blockIter!=function.end(); ++blockIter)
+		{
+			llvm::BasicBlock *BB = &*blockIter;
+			for (auto instIter=BB->begin(); instIter!=BB->end(); ++instIter)
+			{
+				llvm::Instruction *inst = &*instIter;
+				if ( !isValuePresent(inst) )
+					continue;
+				DAGNode *instNode = VertexByValue[inst];
+
+				if ( llvm::isa<llvm::PHINode>(inst) )
+				{
+					auto phi = llvm::cast<llvm::PHINode>(inst);
+					for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+					{
+						auto incomingBB = phi->getIncomingBlock(i);
+						if ( DT && DT->dominates(BB, incomingBB) )
+							continue;
+						auto incomingBranch = incomingBB->getTerminator();
+						if ( incomingBranch && incomingBranch->getNumSuccessors() > 1 )
+							addEdge(instNode, addBranch(incomingBranch));
+						for (auto branch : Controllers[incomingBB])
+							addEdge(instNode, addBranch(branch));
+					}
+				}
+				else if ( inst->mayHaveSideEffects() || llvm::isa<llvm::ReturnInst>(inst) )
+				{
+					for (auto branch : Controllers[BB])
+						addEdge(instNode, addBranch(branch));
+				}
+			}
+		}
+	}
+
+	/// Phi operands flowing in over a back edge are loop-carried and are
+	/// left out of the DAG when a dominator tree is available.
+	void setDominatorTree(llvm::DominatorTree *tree) { DT = tree; }
+
 	void init()
 	{
 		Vertices.clear();
+		VertexByValue.clear();
+		NodeByID.clear();
+		Level.clear();
+		Finish.clear();
+		After.clear();
+		LevelOrder.clear();
+		LevelStart.clear();
+		Expanded.clear();
 		DAGIsLocked = false;
 		hasBeenInitialized = true;
 	}
@@ -65,12 +386,16 @@ public:
 		return true;
 	}
 
-	bool addVoidFunction(llvm::Value* CallValue, int varWidth, 
-						 int varDepth, int opWidth, int opDepth)
+	bool addFunctionCall(llvm::Value* CallValue, int varWidth, 
+						 int varDepth, int opWidth, int opDepth, int area)
 	{
-		
+		assert( hasBeenInitialized && "Builder has not been initialized! Do so with init()");
+
 		auto callInst = llvm::cast<llvm::CallInst>(CallValue);
-		DAGNode *funcNode = addVertex(callInst, FUNC);
+		DAGNode *valNode=nullptr, *funcNode=nullptr;
+		checkAndSet(valNode, funcNode, callInst);
+		Expanded.insert(callInst);
+
 		auto function = callInst->getCalledFunction();
 		if (function)
 			funcNode->setConstName( function->getName() );
@@ -83,26 +408,40 @@ public:
 		funcNode->setOpWidth(opWidth);
 		funcNode->setOpDepth(opDepth);
 
+		//a call costs as much as the callee's critical path and datapath
+		funcNode->setLatency(opDepth);
+		funcNode->setArea(area);
+		funcNode->setUnitClass(CALL);
+
+		//the call depends on each of its arguments
+		for (unsigned i = 0; i < callInst->getNumArgOperands(); ++i)
+		{
+			addOperand(callInst->getArgOperand(i), funcNode);
+		}
+
 		return true;
 	}
 
 
 private:
 	
-	bool addInstruction(llvm::Value* value, DAGNode* parentNode=nullptr)
+	/// Each instruction is expanded exactly once: its operands are linked
+	/// to (possibly placeholder) nodes without recursing into them, and a
+	/// placeholder is filled in when its own instruction is added. The DAG
+	/// is therefore built in one linear pass over the function.
+	bool addInstruction(llvm::Value* value)
 	{    
 		auto inst = llvm::cast<llvm::Instruction>(value);
 
-		// remove unneeded instructions
+		// allocas are addresses, they become variable nodes when used
 		if ( llvm::isa<llvm::AllocaInst>(inst) )
 			return false;
-		if ( llvm::isa<llvm::CmpInst>(inst) )
-			return false;
+		if ( Expanded.count(inst) != 0 )
+			return true;
+		Expanded.insert(inst);
 
 		DAGNode *valNode=nullptr, 
-				*instNode=nullptr/*,
-				*funcNode=nullptr*/;		
-
+				*instNode=nullptr;		
 
 		/// Store
 		if ( llvm::isa<llvm::StoreInst>(inst) ) 
@@ -114,41 +453,82 @@ private:
 		{
 			addLoadInst(valNode, instNode, inst);
 		}
-		//THIS ISN'T WORKING, EVEN THOUGH IT'S BEING CALLED IN THE EXACT
-		// SAME WAY AS IN FUNCTIONINFOPASS.CPP
-		// /// Function call
-		// else if ( llvm::isa<llvm::CallInst>(inst) ) 
-		// {
-
-		// 	valNode = addVertex(inst, VAL);
-		// 	// valNode->setVarWidth( analysis.varWidth );
-		// 	// valNode
-
-		// 	// FOR LATER...
-		// 	// if function is void, just set inst node
-		// 	// 		auto funcType = ->getFunctionType();
-		// 	//		funcType->dump();
-		// 	// else set value and inst node
-
-		// }
-		/// Other
+		/// Phi (loop-carried incoming values are skipped)
+		else if ( llvm::isa<llvm::PHINode>(inst) )
+		{
+			auto phi = llvm::cast<llvm::PHINode>(inst);
+			checkAndSet(valNode, instNode, phi);
+			for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+			{
+				if ( DT && DT->dominates(phi->getParent(), phi->getIncomingBlock(i)) )
+					continue;
+				addOperand(phi->getIncomingValue(i), instNode);
+			}
+		}
+		/// Other (binary ops, compares, casts, selects, GEPs, vector and
+		/// aggregate ops, returns, ...)
 		else
 		{
 			checkAndSet(valNode, instNode, inst);
-
-			// recursively add operands
-			// inst->dump();
-			addOperand(inst->getOperand(0), instNode); // left operand
-			addOperand(inst->getOperand(1), instNode); // right operand
+			for (unsigned i = 0; i < inst->getNumOperands(); ++i)
+			{
+				addOperand(inst->getOperand(i), instNode);
+			}
 		}
+		
+		return true;
+	}
+
+	DAGNode* addBranch(llvm::Instruction *branch)
+	{
+		if ( isValuePresent(branch) )
+			return VertexByValue[branch];
+
+		DAGNode *branchNode = addVertex(branch, BRANCH);
+		branchNode->setCost( costModel->lookup(branch) );
+		branchNode->setConstName( std::string(branch->getOpcodeName()) + "_" + 
+								  branch->getParent()->getName().str() );
+
+		// a branch depends on its condition
+		if ( branch->getNumOperands() > 0 && !llvm::isa<llvm::BasicBlock>(branch->getOperand(0)) )
+			addOperand(branch->getOperand(0), branchNode);
+		return branchNode;
+	}
 
-		// add children to parent
-		if ( parentNode != nullptr )
+	void addMemoryDependence(DAGNode *instNode, llvm::Instruction *inst, llvm::MemoryAccess *clobber,
+							 const llvm::MemoryLocation *location, llvm::MemorySSA &MSSA,
+							 std::unordered_set<llvm::MemoryAccess*> &visitedPhis)
+	{
+		if ( clobber == nullptr || MSSA.isLiveOnEntryDef(clobber) )
+			return;
+
+		// a write on every incoming path may clobber the location, look
+		// for it along each path that is not a back edge
+		if ( llvm::isa<llvm::MemoryPhi>(clobber) )
 		{
-			addEdge(parentNode, valNode);
+			if ( visitedPhis.count(clobber) != 0 )
+				return;
+			visitedPhis.insert(clobber);
+
+			auto phi = llvm::cast<llvm::MemoryPhi>(clobber);
+			for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+			{
+				if ( DT && DT->dominates(phi->getBlock(), phi->getIncomingBlock(i)) )
+					continue;
+				auto incoming = phi->getIncomingValue(i);
+				if ( location != nullptr )
+					incoming = MSSA.getWalker()->getClobberingMemoryAccess(incoming, *location);
+				addMemoryDependence(instNode, inst, incoming, location, MSSA, visitedPhis);
+			}
+			return;
 		}
-		
-		return true;
+
+		auto clobberInst = llvm::cast<llvm::MemoryUseOrDef>(clobber)->getMemoryInst();
+		if ( clobberInst == nullptr || clobberInst == inst || !isValuePresent(clobberInst) )
+			return;
+		if ( DT && !DT->dominates(clobberInst, inst) )
+			return;
+		addEdge(instNode, VertexByValue[clobberInst]);
 	}
 
 	void addStoreInst(DAGNode* &valNode, DAGNode* &instNode, llvm::Instruction *storeInst)
@@ -159,17 +539,6 @@ private:
 		storeVal = storeInst->getOperand(0);
 		targetVal = storeInst->getOperand(1);
 		
-		// add target variable value node
-		if ( isValuePresent(targetVal) )
-		{
-			auto key = VertexByValue[targetVal];
-			valNode = Vertices[key];
-		}
-		else
-		{
-			valNode = addVertex(targetVal, VAL);
-		}
-
 		// set name
 		std::string storeValName, targetValName, storeInstName;
 		if ( storeVal->hasName() )
@@ -196,18 +565,17 @@ private:
 		instNode->setConstName(storeInstName);
 		instNode->setVarWidth(1);
 		instNode->setVarDepth(1);
+		instNode->setCost( costModel->lookup(storeInst) );
 
-		// add edges
-		addEdge(valNode, instNode);
-
-		// recursively add the store value
+		// the store depends on its address and value; the loads it feeds
+		// are linked to it by addMemoryDependences()
+		addOperand(targetVal, instNode);
 		addOperand(storeVal, instNode);
 	}
 
 	void addLoadInst(DAGNode* &valNode, DAGNode* &instNode, llvm::Instruction *loadInst)
 	{
 		llvm::Value *loadVal;
-		DAGNode *loadValNode = nullptr;
 		loadVal = loadInst->getOperand(0);
 
 		// CheckAndSet is not necessary as each load inst WILL
@@ -218,11 +586,6 @@ private:
 		// instNode = addVertex(loadInst, INST);
 		// instNode->setValueNode(valNode);
 
-		// The load value node already exists if it is
-		// being loaded.
-		auto key = VertexByValue[loadVal];
-		loadValNode = Vertices[key];
-
 		// get name
 		std::string loadValName = loadVal->getName();
 		loadValName = "load_" + loadValName;
@@ -236,13 +599,7 @@ private:
 		//Add edges
 		// edge from valNode->instNode added in checkAndSet
 		// addEdge(valNode, instNode); 	//i.e. load_a->load
-		addEdge(instNode, loadValNode);	//i.e. load->a
-
-		// If a value is being loaded it is assumed that
-		// the value has already been stored, so the
-		// recursive addOperand call is NOT necessary.
-		//
-		// addOperand(loadVal, instNode);
+		addOperand(loadVal, instNode);	//i.e. load->a (or load->address)
 	}
 
 	void checkAndSet(DAGNode* &valNode, DAGNode* &instNode, llvm::Value *value)
@@ -256,30 +613,45 @@ private:
 		else
 		{
 			// create a value and inst nodes for the new llvm::value
-			valNode = addVertex(value, VAL);
-			instNode = addVertex(value, INST);
+			// (void instructions produce no value node)
+			vertex_t instType = llvm::isa<llvm::CallInst>(value) ? FUNC : INST;
+			valNode = nullptr;
+			if ( !value->getType()->isVoidTy() )
+				valNode = addVertex(value, VAL);
+			instNode = addVertex(value, instType);
 			instNode->setValueNode(valNode);
 
 			// if the llvm::value is a binary operator inst then update
 			// the add operator width and depth
 			if ( llvm::isa<llvm::BinaryOperator>(value) )
 			{
-				instNode->setOpWidth(1);
+				instNode->setOpWidth( instNode->getLanes() );
 				instNode->setOpDepth(1);
 			}
+			instNode->setCost( costModel->lookup(llvm::cast<llvm::Instruction>(value)) );
 
 			// add an edge valNode->instNode
-			addEdge(valNode, instNode);
+			if ( valNode != nullptr )
+				addEdge(valNode, instNode);
 		}
 	}
 
 	void addOperand(llvm::Value* operand, DAGNode* parentNode)
 	{
-		DAGNode* valNode;
+		DAGNode *valNode=nullptr, *instNode=nullptr;
+
+		// control flow targets, callees and metadata carry no data
+		if ( llvm::isa<llvm::BasicBlock>(operand) || llvm::isa<llvm::Function>(operand) ||
+			 llvm::isa<llvm::MetadataAsValue>(operand) || llvm::isa<llvm::InlineAsm>(operand) )
+			return;
 
-		if ( llvm::isa<llvm::Instruction>(operand) )
+		if ( llvm::isa<llvm::Instruction>(operand) && 
+			 !llvm::isa<llvm::AllocaInst>(operand) )
 		{
-			addInstruction(operand, parentNode);
+			// link to the operand's value node, it is expanded when
+			// its own instruction is added
+			checkAndSet(valNode, instNode, operand);
+			addEdge(parentNode, valNode != nullptr ? valNode : instNode);
 		}
 		else
 		{
@@ -342,10 +714,31 @@ private:
 			return true;
 	}
 
+	/// Read-only lookup, safe while other threads stitch
+	DAGNode* findVertex(const llvm::Value *value, vertex_t type)
+	{
+		auto found = VertexByValue.find( const_cast<llvm::Value*>(value) );
+		if ( found == VertexByValue.end() )
+			return nullptr;
+		auto node = found->second;
+		if ( node->getType() == type )
+			return node;
+		if ( type == VAL )
+			return node->getValueNode();
+		return nullptr;
+	}
+
+	/// Values whose node belongs to the fragment of their defining block
+	static bool isBlockLocal(const llvm::Value *value)
+	{
+		return llvm::isa<llvm::Instruction>(value) && !llvm::isa<llvm::AllocaInst>(value);
+	}
+
 	bool isInvalidOperator(llvm::Instruction *inst)
 	{
-		const char* opName = inst->getOpcodeName(inst->op_begin()->get()->getValueID());
-		if (strcmp(opName, "<Invalid operator>") == 0)
+		// instructions that carry no dataflow
+		if ( llvm::isa<llvm::UnreachableInst>(inst) || llvm::isa<llvm::FenceInst>(inst) ||
+			 llvm::isa<llvm::DbgInfoIntrinsic>(inst) )
 			return true;
 		else
 			return false;
@@ -353,10 +746,14 @@ private:
 
 	bool isBranch(llvm::Instruction *inst)
 	{
-    	if (inst->getOpcode() == llvm::Instruction::Br)
-			return true;
-		else
-			return false;
+		switch ( inst->getOpcode() ) {
+			case (llvm::Instruction::Br):
+			case (llvm::Instruction::Switch):
+			case (llvm::Instruction::IndirectBr):
+				return true;
+			default:
+				return false;
+		}
 	}
 
 	bool isAlloca(llvm::Instruction *inst)
@@ -369,7 +766,8 @@ private:
 
 	bool isReturn(llvm::Instruction *inst)
 	{
-    	if (inst->getOpcode() == llvm::Instruction::Ret)
+		// a returned value is kept as the root of its expression
+    	if (inst->getOpcode() == llvm::Instruction::Ret && inst->getNumOperands() == 0)
 			return true;
 		else
 			return false;
@@ -390,82 +788,541 @@ private:
 		return true;
 	}
 
-	int findHeight()
+public:
+	DAGSchedule findSchedule()
+	{
+		WorkerPool serial(1);
+		return findSchedule(serial);
+	}
+
+	/// The levels, width and finish times come from one DAGTraversal on
+	/// the pool, the rest from linear passes over its order
+	DAGSchedule findSchedule(WorkerPool &pool)
 	{
-		std::vector<DAGNode*> sourceNodes;
-		if ( !findSourceNodes(sourceNodes) )
+		assert( DAGIsLocked && "DAG has not been locked! Do so with lock()");
+		DAGSchedule schedule = {0, 0, 0, 0, 0, 0, 0};
+
+		// ASAP level (in nodes) and finish time (in cycles) of each node,
+		// the node IDs grouped by level and the value nodes per level
+		size_t nodeCount = NodeByID.size();
+		std::vector<int> level(nodeCount, 0), finish(nodeCount, 0);
+		std::vector<int> valuesPerLevel;
+		DAGTraversal traversal(NodeByID);
+		LevelVisitor levels(level);
+		ValueWidthVisitor widths(NodeByID, valuesPerLevel);
+		FinishTimeVisitor finishes(NodeByID, traversal, finish);
+		std::vector<DAGVisitor*> visitors = {&levels, &widths, &finishes};
+		if ( traversal.run(visitors, pool) )
 		{
-			llvm::outs() << " ERROR: No source nodes were found!\n";
-			return false;
+			LevelOrder.swap( traversal.getOrder() );
+			LevelStart.swap( traversal.getLevelStart() );
+		}
+		else
+		{
+			std::fill(level.begin(), level.end(), 0);
+			std::fill(finish.begin(), finish.end(), 0);
+			scheduleDepthFirst(level, finish, valuesPerLevel);
+		}
+
+		// height and width in nodes
+		schedule.height = LevelStart.size() - 2;
+		schedule.width = *std::max_element( valuesPerLevel.begin(), valuesPerLevel.end() );
+		for (auto node : NodeByID)
+		{
+			schedule.latency = std::max(schedule.latency, finish[node->getID()]);
+			schedule.area += node->getArea();
+		}
+
+		// peak operator lanes in flight: each operator is busy over
+		// [finish - latency, finish); data movement is no operator work
+		std::vector<int> inFlight(schedule.latency + 1, 0);
+		for (auto node : NodeByID)
+		{
+			if ( node->getType() == VAL )
+				continue;
+			if ( node->isDataMovement() )
+				schedule.moves++;
+			else if ( node->getLanes() > 1 )
+				schedule.vectorOps++;
+			if ( node->getLatency() <= 0 )
+				continue;
+			inFlight[ finish[node->getID()] - node->getLatency() ] += node->getLanes();
+			inFlight[ finish[node->getID()] ] -= node->getLanes();
+		}
+		int running = 0;
+		for (auto delta : inFlight)
+		{
+			running += delta;
+			schedule.opWidth = std::max(schedule.opWidth, running);
+		}
+
+		// walking the levels down from the results, find the longest path
+		// of dependents above each node; finish + after is the longest
+		// path through a node
+		std::vector<int> after(nodeCount, 0);
+		for (size_t i = nodeCount; i-- > 0; )
+		{
+			auto id = LevelOrder[i];
+			for (auto predecessor_pair : NodeByID[id]->getPredecessors())
+			{
+				auto predecessor = predecessor_pair.second;
+				after[id] = std::max(after[id], after[predecessor->getID()] + predecessor->getLatency());
+			}
+		}
+
+		Level.swap(level);
+		Finish.swap(finish);
+		After.swap(after);
+		return schedule;
+	}
+
+	/// Live values of the ASAP schedule and of a list schedule of at most
+	/// listWidth operators per step (0: the operators spread evenly over
+	/// the ASAP steps). Requires findSchedule(), see LiveRanges.
+	void findLiveValues(unsigned listWidth, LiveProfile &asap, LiveProfile &list)
+	{
+		assert( LevelOrder.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+		LiveRanges ranges(NodeByID, LevelOrder);
+		asap = ranges.run(0);
+		if ( listWidth == 0 )
+		{
+			size_t steps = std::max<size_t>(1, asap.getStepCount());
+			listWidth = std::max<size_t>(1, (ranges.getOperatorCount() + steps - 1) / steps);
+		}
+		list = ranges.run(listWidth);
+	}
+
+	/// Groups of isomorphic, independent expression trees and the width
+	/// and depth of the DAG with each group packed into vector lanes, see
+	/// IsomorphicGroups. Requires findSchedule().
+	IsomorphicAnalysisInfo findIsomorphicGroups()
+	{
+		assert( LevelOrder.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+
+		// the data operands of each operator in order, by node ID
+		std::vector<unsigned> OperandStart(1, 0), Operands;
+		for (auto node : NodeByID)
+		{
+			if ( node->getType() == INST || node->getType() == FUNC )
+			{
+				auto inst = llvm::cast<llvm::Instruction>( node->getllvmValue() );
+				for (auto &operand : inst->operands())
+				{
+					auto found = VertexByValue.find( operand.get() );
+					if ( found != VertexByValue.end() )
+						Operands.push_back( found->second->getID() );
+				}
+			}
+			OperandStart.push_back( Operands.size() );
 		}
-		if ( sourceNodes.empty() )
-			return 0;
+		IsomorphicGroups groups(NodeByID, LevelOrder, Level, OperandStart, Operands);
+		return groups.run();
+	}
 
-		std::vector<int> sourceDepths(sourceNodes.size()); //vector to record depths
-		int index = 0;
+	/// Sets the bit width of every node: a value holds the bits of its
+	/// type, an operator's datapath may be wider (compares, divisions) or
+	/// carry none (branches). Known bits walk the IR, so this runs once on
+	/// the final DAG rather than while the fragments are built.
+	void findBitWidths()
+	{
+		for (auto node : NodeByID)
+		{
+			auto value = node->getllvmValue();
+			if ( node->getType() == VAL )
+				node->setBitWidth( CostModel::getScalarBits(value, true), CostModel::getScalarBits(value, false) );
+			else if ( node->getType() != BRANCH )
+			{
+				auto inst = llvm::cast<llvm::Instruction>(value);
+				node->setBitWidth( CostModel::getDatapathBits(inst, true), CostModel::getDatapathBits(inst, false) );
+			}
+		}
+	}
 
-		for ( auto sourceNode : sourceNodes )
+	/// Operators, bits and area of each unit class at the bits known to
+	/// matter (see CostModel::getScalarBits), and the bit-weighted widths.
+	/// Requires findSchedule().
+	DatapathProfile findDatapath()
+	{
+		assert( LevelOrder.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+		findBitWidths();
+		DatapathProfile profile = {0, 0, std::vector<DatapathAnalysisInfo>(UNIT_COUNT)};
+		for (int unit = NO_UNIT; unit < UNIT_COUNT; ++unit)
+			profile.Classes[unit] = {CostModel::getUnitName((unit_t)unit), 0, 0, 0, 0, 0, 0};
+
+		// each operator is busy over [finish - latency, finish), as in
+		// findSchedule(), with one difference array per unit class
+		int latency = 0;
+		for (auto node : NodeByID)
+			latency = std::max(latency, Finish[node->getID()]);
+		std::vector< std::vector<int64_t> > inFlight(UNIT_COUNT + 1, std::vector<int64_t>(latency + 1, 0));
+		std::vector<uint64_t> valueBits(LevelStart.size(), 0);
+		for (auto node : NodeByID)
 		{
-			//recursive helper funciton that is fed each source/root node
-			// sourceDepths[index] = 0;
-			// std::cout << "\nSource node[" << sourceNode->getName() << "]:" << std::endl;
-			sourceNode->setAllUnvisited();
-			sourceDepths[index] = findHeightWrapper(sourceNode);
-			index++;
+			uint64_t bits = (uint64_t)node->getBitWidth() * node->getLanes();
+			if ( node->getType() == VAL )
+			{
+				valueBits[ Level[node->getID()] ] += bits;
+				continue;
+			}
+
+			auto &unit = profile.Classes[ node->getUnitClass() ];
+			unit.operators++;
+			unit.bits += bits;
+			unit.declaredBits += (uint64_t)node->getDeclaredBits() * node->getLanes();
+			unit.declaredArea += node->getArea();
+			auto inst = llvm::dyn_cast<llvm::Instruction>( node->getllvmValue() );
+			if ( node->getType() == INST && node->getBitWidth() < node->getDeclaredBits() )
+				unit.area += costModel->lookup(inst, node->getBitWidth()).area;
+			else
+				unit.area += node->getArea();
+
+			if ( node->getLatency() <= 0 )
+				continue;
+			int start = Finish[node->getID()] - node->getLatency();
+			for (auto flight : {&inFlight[node->getUnitClass()], &inFlight[UNIT_COUNT]})
+			{
+				(*flight)[start] += bits;
+				(*flight)[ Finish[node->getID()] ] -= bits;
+			}
 		}
 
-		//find maxDepth
-		// int i = 0;
-		int maxDepth = 1;
-		for ( auto depth : sourceDepths )
+		profile.valueBits = *std::max_element( valueBits.begin(), valueBits.end() );
+		for (int unit = NO_UNIT; unit <= UNIT_COUNT; ++unit)
 		{
-			// i++;
-			// std::cout << "depth[" << i << "] = " << depth << std::endl;
-			if ( depth > maxDepth )
-				maxDepth = depth;
+			int64_t running = 0;
+			uint64_t peak = 0;
+			for (auto delta : inFlight[unit])
+			{
+				running += delta;
+				peak = std::max(peak, (uint64_t)running);
+			}
+			if ( unit == UNIT_COUNT )
+				profile.operatorBits = peak;
+			else
+				profile.Classes[unit].peakBits = peak;
 		}
+		return profile;
+	}
+
+	/// Critical path in cycles with the latency of each operator times the
+	/// runs of its block per call, so that a loop body counts once per
+	/// iteration; nodes outside the blocks (arguments, constants) count
+	/// once. Requires findSchedule().
+	double findWeightedLatency(const BlockFrequency_t &Frequency)
+	{
+		assert( LevelOrder.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
 
-		return maxDepth;
+		std::vector<double> finish(NodeByID.size(), 0);
+		double latency = 0;
+		for (auto id : LevelOrder)
+		{
+			auto node = NodeByID[id];
+			double start = 0;
+			for (auto successor_pair : node->getSuccessors())
+				start = std::max(start, finish[ successor_pair.second->getID() ]);
+
+			double runs = 1;
+			auto inst = llvm::dyn_cast_or_null<llvm::Instruction>( node->getllvmValue() );
+			if ( inst != nullptr )
+			{
+				auto frequency = Frequency.find( inst->getParent() );
+				runs = frequency != Frequency.end() ? frequency->second : 0;
+			}
+			finish[id] = start + node->getLatency() * runs;
+			latency = std::max(latency, finish[id]);
+		}
+		return latency;
 	}
 
-	int findHeightWrapper(DAGNode *node)
+	/// Operators of one critical path, from the first dependence to the
+	/// last user; ties go to the dependence with the smallest opcode and
+	/// name so that the path does not depend on the node order. Requires
+	/// findSchedule().
+	std::vector<PathStepInfo> findCriticalPath()
 	{
-		node->setVisited(true);
-		if ( !node->hasSuccessors() )
-			return 1;
+		assert( Finish.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
 
-		// std::cout << "getting successors for Node[" << node->getName() << "]..." << std::endl;
-		auto Successors = node->getSuccessors();
-		std::vector<int> depths(Successors.size());
-		int index = 0;
+		std::vector<PathStepInfo> Path;
+		DAGNode *node = nullptr;
+		PathStepInfo step;
+		for (auto candidate : NodeByID)
+		{
+			if ( node == nullptr || Finish[candidate->getID()] > Finish[node->getID()] ||
+				 (Finish[candidate->getID()] == Finish[node->getID()] && isBefore(candidate, node)) )
+				node = candidate;
+		}
+		while ( node != nullptr )
+		{
+			auto inst = llvm::dyn_cast_or_null<llvm::Instruction>( node->getllvmValue() );
+			if ( inst != nullptr && node->getType() != VAL )
+			{
+				step.opcode = inst->getOpcodeName();
+				auto call = llvm::dyn_cast<llvm::CallInst>(inst);
+				if ( call != nullptr && call->getCalledFunction() != nullptr )
+					step.opcode += " @" + call->getCalledFunction()->getName().str();
+				step.name = getLabel(node).str();
+				step.latency = node->getLatency();
+				Path.push_back(step);
+			}
 
-		for ( auto successor_pair : Successors )
+			int start = Finish[node->getID()] - node->getLatency();
+			DAGNode *next = nullptr;
+			for (auto successor_pair : node->getSuccessors())
+			{
+				auto successor = successor_pair.second;
+				if ( Finish[successor->getID()] == start && (next == nullptr || isBefore(successor, next)) )
+					next = successor;
+			}
+			node = next;
+		}
+		std::reverse(Path.begin(), Path.end());
+		return Path;
+	}
+
+	/// Writes the live values and bits of both schedules by step to
+	/// <directory>/<function>_Live.csv
+	bool writeLiveTimeline(std::string functionName, std::string directory,
+						   const LiveProfile &asap, const LiveProfile &list)
+	{
+		std::string filePath = directory + "/" + functionName + "_Live.csv";
+		DOTWriter out;
+		if ( !openGraphFile(out, directory, filePath) )
+			return false;
+
+		out << "step,asap_values,asap_bits,list_values,list_bits\n";
+		size_t steps = std::max(asap.getStepCount(), list.getStepCount());
+		for (size_t step = 0; step < steps; ++step)
 		{
-			auto successor = successor_pair.second;
-			if ( !successor->hasBeenVisited() )
+			out << std::to_string(step) << ",";
+			if ( step < asap.getStepCount() )
+				out << std::to_string(asap.Values[step]) << "," << std::to_string(asap.Bits[step]);
+			else
+				out << ",";
+			out << ",";
+			if ( step < list.getStepCount() )
+				out << std::to_string(list.Values[step]) << "," << std::to_string(list.Bits[step]);
+			else
+				out << ",";
+			out << "\n";
+		}
+		if ( !out.close() )
+		{
+			llvm::outs() << " ERROR: Live timeline could not be written!\n";
+			return false;
+		}
+
+		llvm::outs() << " -- Live timeline generated at: " << filePath << "\n";
+		return true;
+	}
+
+	/// Hash-consing: merges nodes that compute the same expression, keyed
+	/// by opcode, result type and the representatives of their operands
+	/// (constants by value). Nodes are visited dependences first, so each
+	/// key is formed from operands that are already merged. Phis, calls,
+	/// branches, allocas and side-effecting operators keep their identity;
+	/// a load only merges with a load of the same address under the same
+	/// memory dependences. Requires findSchedule(); the DAG has to be
+	/// locked and scheduled again afterwards. Returns the nodes removed.
+	size_t hashCons()
+	{
+		assert( LevelOrder.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+
+		std::vector<unsigned> Rep( NodeByID.size() );
+		for (size_t id = 0; id < Rep.size(); ++id)
+			Rep[id] = id;
+
+		std::unordered_map<std::vector<uint64_t>, unsigned, ConsKeyHash> Table;
+		std::vector<uint64_t> key;
+		for (auto id : LevelOrder)
+		{
+			if ( getConsKey(NodeByID[id], Rep, key) )
+				Rep[id] = Table.insert( std::make_pair(key, id) ).first->second;
+		}
+
+		// lookups by value land on the representative
+		for (auto &value_pair : VertexByValue)
+			value_pair.second = NodeByID[ Rep[value_pair.second->getID()] ];
+
+		// move the dependents of each duplicate onto its representative
+		size_t removed = 0;
+		for (auto node : NodeByID)
+		{
+			auto rep = NodeByID[ Rep[node->getID()] ];
+			if ( rep == node )
+				continue;
+
+			for (auto predecessor_pair : node->getPredecessors())
 			{
+				auto predecessor = predecessor_pair.second;
+				predecessor->removeSuccessor(node);
+				addEdge(predecessor, rep);
+			}
+			for (auto successor_pair : node->getSuccessors())
+				successor_pair.second->removePredecessor(node);
+			Vertices.erase(node);
+			removed++;
+		}
+		for (auto node : NodeByID)
+		{
+			if ( Rep[node->getID()] != node->getID() )
+				delete node;
+		}
+
+		NodeByID.clear();
+		Level.clear();
+		Finish.clear();
+		After.clear();
+		LevelOrder.clear();
+		LevelStart.clear();
+		DAGIsLocked = false;
+		return removed;
+	}
+
+private:
+	/// Fallback for a graph with a cycle: post-order with an explicit
+	/// stack. Successors are the dependencies of a node; an edge back onto
+	/// the stack closes a loop-carried cycle and is ignored. Level 0 marks
+	/// an unfinished node. The IDs are then grouped by level.
+	void scheduleDepthFirst(std::vector<int> &level, std::vector<int> &finish, std::vector<int> &valuesPerLevel)
+	{
+		size_t nodeCount = NodeByID.size();
+		VisitMarks onStack(nodeCount);
+		std::vector< std::pair<DAGNode*, DAGVertexList::iterator> > stack;
 
-				//find total varDepth
-				if ( successor->isStoreInstNext() )
+		for (auto root : NodeByID)
+		{
+			if ( level[root->getID()] != 0 )
+				continue;
+
+			onStack.visit( root->getID() );
+			stack.push_back( std::make_pair(root, root->getSuccessors().begin()) );
+			while ( !stack.empty() )
+			{
+				auto node = stack.back().first;
+				auto &successorIter = stack.back().second;
+				if ( successorIter != node->getSuccessors().end() )
 				{
-					depths[index] = findHeightWrapper(successor) + 1;
+					auto successor = successorIter->second;
+					++successorIter;
+					if ( level[successor->getID()] == 0 && onStack.visit( successor->getID() ) )
+						stack.push_back( std::make_pair(successor, successor->getSuccessors().begin()) );
+					continue;
 				}
-				else
+
+				int maxLevel = 0, maxFinish = 0;
+				for (auto successor_pair : node->getSuccessors())
 				{
-					depths[index] = findHeightWrapper(successor);
+					auto successorID = successor_pair.second->getID();
+					maxLevel = std::max(maxLevel, level[successorID]);
+					maxFinish = std::max(maxFinish, finish[successorID]);
 				}
-				// std::cout << "Node[" << successor->getName() << "] depth = " << depths[index] << std::endl;
-				index++;
+				level[node->getID()] = maxLevel + 1;
+				finish[node->getID()] = maxFinish + node->getLatency();
+
+				onStack.unvisit( node->getID() );
+				stack.pop_back();
 			}
 		}
 
-		return *std::max_element( depths.begin(), depths.end() );
+		// group the IDs by level (counting sort)
+		int height = 0;
+		for (auto node : NodeByID)
+			height = std::max(height, level[node->getID()]);
+		LevelStart.assign(height + 2, 0);
+		valuesPerLevel.assign(height + 1, 0);
+		for (auto node : NodeByID)
+		{
+			LevelStart[ level[node->getID()] + 1 ]++;
+			if ( node->getType() == VAL )
+				valuesPerLevel[ level[node->getID()] ] += node->getLanes();
+		}
+		for (size_t l = 1; l < LevelStart.size(); ++l)
+			LevelStart[l] += LevelStart[l-1];
+		LevelOrder.assign(nodeCount, 0);
+		std::vector<size_t> fill(LevelStart.begin(), LevelStart.end() - 1);
+		for (auto node : NodeByID)
+			LevelOrder[ fill[ level[node->getID()] ]++ ] = node->getID();
 	}
 
+	struct ConsKeyHash
+	{
+		size_t operator()(const std::vector<uint64_t> &key) const
+		{
+			return llvm::hash_combine_range( key.begin(), key.end() );
+		}
+	};
 
+	/// False for nodes that may not be merged with any other
+	bool getConsKey(DAGNode *node, std::vector<unsigned> &Rep, std::vector<uint64_t> &key)
+	{
+		auto value = const_cast<llvm::Value*>( node->getllvmValue() );
+		key.clear();
+		key.push_back( node->getType() );
+		key.push_back( reinterpret_cast<uintptr_t>(value->getType()) );
 
+		if ( node->getType() == VAL )
+		{
+			if ( llvm::isa<llvm::Instruction>(value) && !llvm::isa<llvm::AllocaInst>(value) )
+			{
+				// the value of an operator is its operator node
+				for (auto successor_pair : node->getSuccessors())
+					key.push_back( Rep[successor_pair.second->getID()] );
+				return true;
+			}
+			if ( auto CI = llvm::dyn_cast<llvm::ConstantInt>(value) )
+			{
+				appendWords(key, CI->getValue());
+				return true;
+			}
+			if ( auto CF = llvm::dyn_cast<llvm::ConstantFP>(value) )
+			{
+				appendWords(key, CF->getValueAPF().bitcastToAPInt());
+				return true;
+			}
+			// arguments, globals and allocas are distinct storage
+			return false;
+		}
 
+		if ( node->getType() != INST )
+			return false;
+		auto inst = llvm::cast<llvm::Instruction>(value);
+		if ( inst->mayHaveSideEffects() || llvm::isa<llvm::PHINode>(inst) ||
+			 llvm::isa<llvm::AllocaInst>(inst) || inst->isEHPad() )
+			return false;
+
+		key.push_back( inst->getOpcode() );
+		if ( auto cmp = llvm::dyn_cast<llvm::CmpInst>(inst) )
+			key.push_back( cmp->getPredicate() );
+		if ( auto extract = llvm::dyn_cast<llvm::ExtractValueInst>(inst) )
+			key.insert( key.end(), extract->idx_begin(), extract->idx_end() );
+		if ( auto insert = llvm::dyn_cast<llvm::InsertValueInst>(inst) )
+			key.insert( key.end(), insert->idx_begin(), insert->idx_end() );
+
+		// operands in order, then every dependence (memory and control
+		// included) as a set
+		for (auto &operand : inst->operands())
+		{
+			auto operandNode = findVertex(operand.get(), VAL);
+			if ( operandNode != nullptr )
+				key.push_back( Rep[operandNode->getID()] );
+			else
+				key.push_back( reinterpret_cast<uintptr_t>(operand.get()) );
+		}
+		key.push_back(UINT64_MAX);
+		size_t dependences = key.size();
+		for (auto successor_pair : node->getSuccessors())
+			key.push_back( Rep[successor_pair.second->getID()] );
+		std::sort(key.begin() + dependences, key.end());
+		return true;
+	}
+
+	static void appendWords(std::vector<uint64_t> &key, const llvm::APInt &bits)
+	{
+		key.push_back( bits.getBitWidth() );
+		key.insert( key.end(), bits.getRawData(), bits.getRawData() + bits.getNumWords() );
+	}
 
+private:
 	// int getMaxVarWidth(DAGNode *root)
 	// {
 
@@ -551,73 +1408,274 @@ public:
 	// }
 	
 
-	bool DOTGenerateFile(std::string functionName)
+	/// Streams the locked DAG to <directory>/<function>_Graph.dot in one
+	/// pass over the dense node IDs: every node, then the edges to its
+	/// successors. Memory use does not grow with the graph.
+	bool DOTGenerateFile(std::string functionName, std::string directory, WorkerPool &pool)
 	{
-		std::vector<DAGNode*> sourceNodes;
-		if ( !findSourceNodes(sourceNodes) )
+		assert( DAGIsLocked && "DAG has not been locked! Do so with lock()");
+		if ( NodeByID.empty() )
 		{
 			llvm::outs() << " ERROR: No source nodes were found!\n";
 			return false;
 		}
 
-		// stream to collect file output
-		std::ostringstream outSS;
+		std::string filePath = directory + "/" + functionName + "_Graph.dot";
+		DOTWriter out;
+		if ( !openGraphFile(out, directory, filePath) )
+			return false;
 
 		// init graph and node specs
-		outSS << "digraph g{" << std::endl;
-		outSS << "\tnode [shape = record,height = .1];" << std::endl << std::endl;
-		outSS << "\tlabelloc = \"t\";" << std::endl;
-		outSS << "\tlabel = \"" << functionName << "_DAG" << "\";" << std::endl;
+		out << "digraph g{\n";
+		out << "\tnode [shape = record,height = .1];\n\n";
+		out << "\tlabelloc = \"t\";\n";
+		out << "\tlabel = \"";
+		out.writeEscaped(functionName);
+		out << "_DAG\";\n\n";
+
+		// nodes in level order, rendered on the pool; with a cycle the
+		// nodes left unvisited follow in ID order
+		DAGTraversal traversal(NodeByID);
+		DOTVisitor dot(NodeByID, out);
+		std::vector<DAGVisitor*> visitors(1, &dot);
+		if ( !traversal.run(visitors, pool) )
+		{
+			std::vector<bool> written(NodeByID.size(), false);
+			for (auto id : traversal.getOrder())
+				written[id] = true;
+			DOTBuffer rest;
+			for (auto node : NodeByID)
+			{
+				if ( !written[node->getID()] )
+					DOTVisitor::render(rest, node);
+			}
+			out.write(rest.data(), rest.size());
+		}
+		out << "}\n";
 
-		// generate node markup for each source/root node
-		for (auto root : sourceNodes)
+		if ( !out.close() )
 		{
-			outSS << std::endl;
-			outSS << "\tsubgraph " << root->getName() << " {" << std::endl;
-			root->DOTcreateNode(outSS);
-			DOTAddSuccessor(outSS, root);
-			outSS << "\t}" << std::endl;
+			llvm::outs() << " ERROR: DOT file could not be written!\n";
+			return false;
 		}
-		outSS << "}" << std::endl;
 
-		// Create and add to the .dot file
-		std::string filePath = "../../dotFiles/" + functionName + "_Graph.dot";
-		std::ofstream dotFile(filePath);
-		if ( dotFile.is_open() )
+		llvm::outs() << " -- DOT file generated at: " << filePath << "\n";
+		return true;
+	}
+
+	/// Writes a reduced graph to <directory>/<function>_Summary.dot, see
+	/// DAGSummary. Requires findSchedule() to have run.
+	bool DOTGenerateSummary(llvm::Function &function, std::string directory,
+							const DOTSummaryOptions &options, llvm::LoopInfo *LI)
+	{
+		assert( DAGIsLocked && "DAG has not been locked! Do so with lock()");
+		assert( Level.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+		if ( NodeByID.empty() )
 		{
-			dotFile << outSS.str();
-			dotFile.close();
+			llvm::outs() << " ERROR: No source nodes were found!\n";
+			return false;
 		}
-		else
+
+		std::string filePath = directory + "/" + function.getName().str() + "_Summary.dot";
+		DOTWriter out;
+		if ( !openGraphFile(out, directory, filePath) )
+			return false;
+
+		DAGSummary summary(NodeByID, Level, Finish, After, options);
+		summary.write(out, function, LI);
+		if ( !out.close() )
 		{
-			llvm::outs() << " ERROR: DOT file did not open!\n";
+			llvm::outs() << " ERROR: DOT file could not be written!\n";
 			return false;
 		}
 
-		llvm::outs() << " -- DOT file generated at: " << filePath << "\n";
+		llvm::outs() << " -- DOT summary (" << summary.getSummaryNodeCount() << " of "
+					 << NodeByID.size() << " nodes) generated at: " << filePath << "\n";
 		return true;
 	}
 
-	bool DOTAddSuccessor(std::ostringstream &outSS, DAGNode* parentNode)
+	/// Draws the scheduled DAG to <directory>/<function>_Graph.svg with the
+	/// built-in layered layout, see SVGRenderer
+	bool SVGGenerateFile(std::string functionName, std::string directory, WorkerPool &pool)
 	{
-		if ( !parentNode->hasSuccessors() )
+		assert( DAGIsLocked && "DAG has not been locked! Do so with lock()");
+		assert( Level.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+		if ( NodeByID.empty() )
+		{
+			llvm::outs() << " ERROR: No source nodes were found!\n";
+			return false;
+		}
+
+		std::string filePath = directory + "/" + functionName + "_Graph.svg";
+		DOTWriter out;
+		if ( !openGraphFile(out, directory, filePath) )
 			return false;
 
-		auto Successors = parentNode->getSuccessors();
-		DAGNode *successor;
-		for (auto successor_pair : Successors)
+		SVGRenderer renderer(NodeByID, Level, Finish, After, LevelOrder, LevelStart);
+		renderer.write(out, functionName, pool);
+		if ( !out.close() )
 		{
-			successor = successor_pair.second;
-			// to prevent an infinite loop mark as visited
-			if ( !successor->hasBeenVisited() )
-			{
-				successor->setVisited(true);
-				successor->DOTcreateNode(outSS, parentNode);
-				DOTAddSuccessor(outSS, successor);
-			}
+			llvm::outs() << " ERROR: SVG file could not be written!\n";
+			return false;
+		}
+
+		llvm::outs() << " -- SVG file generated at: " << filePath << "\n";
+		return true;
+	}
+
+	/// Writes the scheduled DAG to <directory>/<function>.dag in the binary
+	/// format of DAGFile.h, sequentially: header, node table, CSR edges
+	/// (sorted by ID) and string table
+	bool writeDAGFile(std::string functionName, std::string directory, const DAGSchedule &schedule)
+	{
+		assert( DAGIsLocked && "DAG has not been locked! Do so with lock()");
+		assert( Level.size() == NodeByID.size() && "DAG has not been scheduled! Do so with findSchedule()");
+
+		std::string filePath = directory + "/" + functionName + ".dag";
+		DOTWriter out;
+		if ( !openGraphFile(out, directory, filePath) )
+			return false;
+
+		// lay out the string table, offset 0 is the empty string
+		uint64_t nodeCount = NodeByID.size(), edgeCount = 0, stringSize = 1;
+		std::vector<uint32_t> NameOffset(nodeCount, 0);
+		uint32_t functionNameOffset = stringSize;
+		stringSize += functionName.size() + 1;
+		for (auto node : NodeByID)
+		{
+			edgeCount += node->getSuccessors().size();
+			auto label = getLabel(node);
+			if ( label.empty() )
+				continue;
+			NameOffset[ node->getID() ] = stringSize;
+			stringSize += label.size() + 1;
+		}
+
+		DAGFileHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, DAGFileMagic, sizeof(DAGFileMagic));
+		header.version = DAGFileVersion;
+		header.byteOrder = DAGFileByteOrder;
+		header.nodeCount = nodeCount;
+		header.edgeCount = edgeCount;
+		header.nodeTableOffset = DAGFileAlign( sizeof(DAGFileHeader) );
+		header.edgeOffsetsOffset = DAGFileAlign( header.nodeTableOffset + nodeCount*sizeof(DAGFileNode) );
+		header.edgeTargetsOffset = DAGFileAlign( header.edgeOffsetsOffset + (nodeCount+1)*sizeof(uint64_t) );
+		header.stringTableOffset = DAGFileAlign( header.edgeTargetsOffset + edgeCount*sizeof(uint32_t) );
+		header.stringTableSize = stringSize;
+		header.functionName = functionNameOffset;
+		header.height = schedule.height;
+		header.width = schedule.width;
+		header.latency = schedule.latency;
+		header.opWidth = schedule.opWidth;
+		header.area = schedule.area;
+		uint64_t written = 0;
+		writeDAGSection(out, written, &header, sizeof(header), header.nodeTableOffset);
+
+		for (auto node : NodeByID)
+		{
+			DAGFileNode record;
+			auto value = node->getllvmValue();
+			auto inst = llvm::dyn_cast<llvm::Instruction>(value);
+			record.type = node->getType();
+			record.opcode = (inst && node->getType() != VAL) ? inst->getOpcode() : 0;
+			record.unit = node->getUnitClass();
+			record.name = NameOffset[ node->getID() ];
+			record.valueNode = node->getValueNode() ? node->getValueNode()->getID() : DAGFileNoNode;
+			record.bits = value->getType()->isSized() ? value->getType()->getScalarSizeInBits() : 0;
+			record.latency = node->getLatency();
+			record.area = node->getArea();
+			record.level = Level[ node->getID() ];
+			record.finish = Finish[ node->getID() ];
+			writeDAGSection(out, written, &record, sizeof(record), 0);
+		}
+		writeDAGSection(out, written, nullptr, 0, header.edgeOffsetsOffset);
+
+		uint64_t edgeOffset = 0;
+		writeDAGSection(out, written, &edgeOffset, sizeof(edgeOffset), 0);
+		for (auto node : NodeByID)
+		{
+			edgeOffset += node->getSuccessors().size();
+			writeDAGSection(out, written, &edgeOffset, sizeof(edgeOffset), 0);
+		}
+		writeDAGSection(out, written, nullptr, 0, header.edgeTargetsOffset);
+
+		std::vector<uint32_t> targets;
+		for (auto node : NodeByID)
+		{
+			targets.clear();
+			for (auto successor_pair : node->getSuccessors())
+				targets.push_back( successor_pair.second->getID() );
+			std::sort(targets.begin(), targets.end());
+			writeDAGSection(out, written, targets.data(), targets.size()*sizeof(uint32_t), 0);
+		}
+		writeDAGSection(out, written, nullptr, 0, header.stringTableOffset);
+
+		out << '\0' << llvm::StringRef(functionName) << '\0';
+		for (auto node : NodeByID)
+		{
+			auto label = getLabel(node);
+			if ( !label.empty() )
+				out << label << '\0';
+		}
+
+		if ( !out.close() )
+		{
+			llvm::outs() << " ERROR: DAG file could not be written!\n";
+			return false;
 		}
-		parentNode->setAllUnvisited(); //reset visited status for next print call
 
+		llvm::outs() << " -- DAG file generated at: " << filePath << "\n";
+		return true;
+	}
+
+private:
+	/// Appends size bytes, then zeros up to the next section at
+	/// sectionOffset (0 for none)
+	void writeDAGSection(DOTWriter &out, uint64_t &written, const void *data, size_t size, uint64_t sectionOffset)
+	{
+		out.write(static_cast<const char*>(data), size);
+		written += size;
+		while ( written < sectionOffset )
+		{
+			out << '\0';
+			written++;
+		}
+	}
+
+	/// Order of the critical path ties, see findCriticalPath
+	bool isBefore(DAGNode *x, DAGNode *y)
+	{
+		auto xInst = llvm::dyn_cast_or_null<llvm::Instruction>( x->getllvmValue() );
+		auto yInst = llvm::dyn_cast_or_null<llvm::Instruction>( y->getllvmValue() );
+		unsigned xOpcode = xInst != nullptr ? xInst->getOpcode() : 0;
+		unsigned yOpcode = yInst != nullptr ? yInst->getOpcode() : 0;
+		if ( xOpcode != yOpcode )
+			return xOpcode < yOpcode;
+		return getLabel(x) < getLabel(y);
+	}
+
+	llvm::StringRef getLabel(DAGNode *node)
+	{
+		if ( !node->getConstName().empty() )
+			return node->getConstName();
+		if ( node->getllvmValue()->hasName() )
+			return node->getllvmValue()->getName();
+		return "";
+	}
+
+	bool openGraphFile(DOTWriter &out, std::string directory, std::string filePath)
+	{
+		if ( llvm::sys::fs::create_directories(directory) )
+		{
+			llvm::outs() << " ERROR: Output directory '" << directory << "' could not be created!\n";
+			return false;
+		}
+		if ( !out.open(filePath) )
+		{
+			llvm::outs() << " ERROR: " << filePath << " did not open!\n";
+			return false;
+		}
 		return true;
 	}
 
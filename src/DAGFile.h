@@ -0,0 +1,234 @@
+#ifndef DAG_FILE_H
+#define DAG_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Binary format of a locked DAG (.dag), one function per file. Sections
+ * follow each other in this order, each starting on an 8-byte boundary:
+ *
+ *   DAGFileHeader                       offsets and counts of the sections
+ *   DAGFileNode[nodeCount]              node attributes, indexed by node ID
+ *   uint64_t edgeOffsets[nodeCount+1]   CSR row offsets into edgeTargets
+ *   uint32_t edgeTargets[edgeCount]     successor (dependence) IDs
+ *   char strings[stringTableSize]       NUL-terminated labels, offset 0 is ""
+ *
+ * Integers are stored in the writer's byte order; byteOrder lets a reader
+ * detect a mismatch. The version changes with any layout change.
+ */
+static const char DAGFileMagic[8] = {'L', 'L', 'V', 'M', 'D', 'A', 'G', '\n'};
+static const uint32_t DAGFileVersion = 1;
+static const uint32_t DAGFileByteOrder = 0x01020304;
+static const uint32_t DAGFileNoNode = UINT32_MAX;
+
+struct DAGFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t nodeCount;
+	uint64_t edgeCount;
+	uint64_t nodeTableOffset;
+	uint64_t edgeOffsetsOffset;
+	uint64_t edgeTargetsOffset;
+	uint64_t stringTableOffset;
+	uint64_t stringTableSize;
+	uint32_t functionName;	//string table offset
+	int32_t height;			//schedule of the whole DAG, see DAGSchedule
+	int32_t width;
+	int32_t latency;
+	int32_t opWidth;
+	int32_t area;
+};
+static_assert(sizeof(DAGFileHeader) == 96, "DAG file header layout changed");
+
+struct DAGFileNode
+{
+	uint32_t type;			//vertex_t
+	uint32_t opcode;		//llvm::Instruction opcode, 0 for values
+	uint32_t unit;			//unit_t
+	uint32_t name;			//string table offset of the label
+	uint32_t valueNode;		//ID of an operator's value node, or DAGFileNoNode
+	uint32_t bits;			//scalar bit width of the value, 0 if none
+	int32_t latency;
+	int32_t area;
+	int32_t level;			//ASAP level
+	int32_t finish;			//ASAP finish time (cycles)
+};
+static_assert(sizeof(DAGFileNode) == 40, "DAG file node layout changed");
+
+/// Sections start on 8-byte boundaries
+inline uint64_t DAGFileAlign(uint64_t offset)
+{
+	return (offset + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief MappedDAG
+ * Read-only view of a .dag file mapped into memory. Nothing is copied or
+ * parsed: the accessors point into the mapping, so loading is constant
+ * time and needs neither LLVM nor the estimator pipeline.
+ */
+class MappedDAG
+{
+private:
+	void *mapping;
+	size_t mappingSize;
+	const DAGFileHeader *Header;
+	const DAGFileNode *Nodes;
+	const uint64_t *EdgeOffsets;
+	const uint32_t *EdgeTargets;
+	const char *Strings;
+
+	MappedDAG(const MappedDAG&) = delete;
+	MappedDAG& operator=(const MappedDAG&) = delete;
+
+public:
+	MappedDAG() : mapping(nullptr), mappingSize(0), Header(nullptr), Nodes(nullptr),
+		EdgeOffsets(nullptr), EdgeTargets(nullptr), Strings(nullptr) {}
+	~MappedDAG() { close(); }
+
+	/// Maps and validates fileName, on failure error says why
+	bool open(const std::string &fileName, std::string &error)
+	{
+		close();
+		int fd = ::open(fileName.c_str(), O_RDONLY);
+		if ( fd < 0 )
+		{
+			error = "could not open '" + fileName + "'";
+			return false;
+		}
+		struct stat status;
+		if ( fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(DAGFileHeader) )
+		{
+			::close(fd);
+			error = "'" + fileName + "' is too small to be a DAG file";
+			return false;
+		}
+		mappingSize = status.st_size;
+		mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if ( mapping == MAP_FAILED )
+		{
+			mapping = nullptr;
+			error = "could not map '" + fileName + "'";
+			return false;
+		}
+
+		auto base = static_cast<const char*>(mapping);
+		Header = reinterpret_cast<const DAGFileHeader*>(base);
+		if ( !validate(error) )
+		{
+			error = "'" + fileName + "' " + error;
+			close();
+			return false;
+		}
+		Nodes = reinterpret_cast<const DAGFileNode*>(base + Header->nodeTableOffset);
+		EdgeOffsets = reinterpret_cast<const uint64_t*>(base + Header->edgeOffsetsOffset);
+		EdgeTargets = reinterpret_cast<const uint32_t*>(base + Header->edgeTargetsOffset);
+		Strings = base + Header->stringTableOffset;
+		return true;
+	}
+
+	void close()
+	{
+		if ( mapping != nullptr )
+			munmap(mapping, mappingSize);
+		mapping = nullptr;
+		Header = nullptr;
+	}
+
+	const DAGFileHeader& getHeader() const { return *Header; }
+	uint64_t getNodeCount() const { return Header->nodeCount; }
+	uint64_t getEdgeCount() const { return Header->edgeCount; }
+	const char* getFunctionName() const { return getString(Header->functionName); }
+
+	const DAGFileNode& getNode(uint32_t id) const { return Nodes[id]; }
+	const char* getName(uint32_t id) const { return getString(Nodes[id].name); }
+
+	/// Successors (dependences) of a node are [successorsBegin, successorsEnd)
+	const uint32_t* successorsBegin(uint32_t id) const { return EdgeTargets + EdgeOffsets[id]; }
+	const uint32_t* successorsEnd(uint32_t id) const { return EdgeTargets + EdgeOffsets[id+1]; }
+	uint64_t getSuccessorCount(uint32_t id) const { return EdgeOffsets[id+1] - EdgeOffsets[id]; }
+
+	const char* getString(uint32_t offset) const
+	{
+		return offset < Header->stringTableSize ? Strings + offset : "";
+	}
+
+private:
+	/// Every section must lie inside the file and every edge must
+	/// name a node, so the accessors need no checks
+	bool validate(std::string &error)
+	{
+		if ( std::memcmp(Header->magic, DAGFileMagic, sizeof(DAGFileMagic)) != 0 )
+		{
+			error = "is not a DAG file";
+			return false;
+		}
+		if ( Header->byteOrder != DAGFileByteOrder )
+		{
+			error = "was written with another byte order";
+			return false;
+		}
+		if ( Header->version != DAGFileVersion )
+		{
+			error = "has format version " + std::to_string(Header->version) +
+					", expected " + std::to_string(DAGFileVersion);
+			return false;
+		}
+
+		uint64_t nodeCount = Header->nodeCount, edgeCount = Header->edgeCount;
+		if ( nodeCount >= DAGFileNoNode ||
+			 !fits(Header->nodeTableOffset, nodeCount, sizeof(DAGFileNode)) ||
+			 !fits(Header->edgeOffsetsOffset, nodeCount + 1, sizeof(uint64_t)) ||
+			 !fits(Header->edgeTargetsOffset, edgeCount, sizeof(uint32_t)) ||
+			 !fits(Header->stringTableOffset, Header->stringTableSize, 1) ||
+			 Header->stringTableSize == 0 )
+		{
+			error = "is truncated or corrupt";
+			return false;
+		}
+
+		auto base = static_cast<const char*>(mapping);
+		auto offsets = reinterpret_cast<const uint64_t*>(base + Header->edgeOffsetsOffset);
+		auto targets = reinterpret_cast<const uint32_t*>(base + Header->edgeTargetsOffset);
+		auto strings = base + Header->stringTableOffset;
+		if ( offsets[0] != 0 || offsets[nodeCount] != edgeCount || strings[Header->stringTableSize-1] != '\0' )
+		{
+			error = "is truncated or corrupt";
+			return false;
+		}
+		for (uint64_t id = 0; id < nodeCount; ++id)
+		{
+			if ( offsets[id] > offsets[id+1] )
+			{
+				error = "has corrupt edge offsets";
+				return false;
+			}
+		}
+		for (uint64_t edge = 0; edge < edgeCount; ++edge)
+		{
+			if ( targets[edge] >= nodeCount )
+			{
+				error = "has an edge to a missing node";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool fits(uint64_t offset, uint64_t count, uint64_t size)
+	{
+		return offset % 8 == 0 && offset <= mappingSize &&
+			   count <= (mappingSize - offset) / size;
+	}
+};
+
+#endif /* DAG_FILE_H */
@@ -5,9 +5,13 @@
 #include <sstream>
 #include <unordered_map>
 #include <llvm/IR/Instruction.h>
+#include <llvm/IR/Instructions.h>
+#include "CostModel.h"
+#include "DOTWriter.h"
+#include "VisitMarks.h"
 
 class DAGNode;
-typedef enum vertex_t{VAL, INST, FUNC} vertex_t;
+typedef enum vertex_t{VAL, INST, FUNC, BRANCH} vertex_t;
 typedef enum adjNode_t{IN, OUT} adjNode_t;
 typedef std::map<DAGNode*, DAGNode*> DAGVertexList;
 typedef std::map<llvm::Value*, DAGNode*> DAGValueList;
@@ -19,7 +23,12 @@ private:
 	int varDepth;
 	int opWidth;
 	int opDepth;
-	bool visited;
+	int latency;
+	int area;
+	unit_t unitClass;
+	unsigned bitWidth;		//bits of one lane, narrowed by known bits
+	unsigned declaredBits;	//bits of one lane of the IR type
+	unsigned id; //dense index, assigned when the DAG is locked
 	DAGNode* valueNode;
 	llvm::Value* llvmValue; //holds either inst or value
 	vertex_t type;
@@ -29,31 +38,71 @@ private:
 
 
 public:
-	DAGNode() : varWidth(0), varDepth(0), opWidth(0), opDepth(0), visited(false), valueNode(nullptr), type(VAL) {}
+	DAGNode() : varWidth(0), varDepth(0), opWidth(0), opDepth(0), latency(0), area(0),
+		unitClass(NO_UNIT), bitWidth(0), declaredBits(0), id(0), valueNode(nullptr), type(VAL) {}
 	DAGNode(llvm::Value* value, vertex_t type) : varWidth(0), varDepth(0), 
-		opWidth(0), opDepth(0), visited(false), valueNode(nullptr), llvmValue(value), type(type) {}
+		opWidth(0), opDepth(0), latency(0), area(0), unitClass(NO_UNIT), bitWidth(0), declaredBits(0), id(0),
+		valueNode(nullptr), llvmValue(value), type(type) {}
 	~DAGNode() {}
 
 	int getVarWidth() { return varWidth; }
 	int getVarDepth() { return varDepth; }
 	int getOpWidth() { return opWidth; }
 	int getOpDepth() { return opDepth; }
+	int getLatency() { return latency; }
+	int getArea() { return area; }
+	unit_t getUnitClass() { return unitClass; }
+	unsigned getBitWidth() { return bitWidth; }
+	unsigned getDeclaredBits() { return declaredBits; }
+	unsigned getID() { return id; }
 	vertex_t getType() { return type; }
 	const llvm::Value* getllvmValue() { return llvmValue; }
 	llvm::Type* getllvmValueTy() { return llvmValue->getType(); }
-	std::string getConstName() { return constName; }
+	const std::string& getConstName() { return constName; }
 	DAGNode* getValueNode() { return valueNode; }
+
+	/// Lanes of parallel work: the elements of a vector value or operator
+	/// (a store by its value operand), 0 for the vector data movement of
+	/// shuffles, extracts and inserts, which only rearranges lanes
+	unsigned getLanes()
+	{
+		if ( llvmValue == nullptr )
+			return 1;
+		if ( isDataMovement() )
+			return 0;
+		if ( auto store = llvm::dyn_cast<llvm::StoreInst>(llvmValue) )
+			return CostModel::getLaneCount( store->getValueOperand()->getType() );
+		return CostModel::getLaneCount( llvmValue->getType() );
+	}
+
+	bool isDataMovement()
+	{
+		return llvmValue != nullptr &&
+			   ( llvm::isa<llvm::ExtractElementInst>(llvmValue) || llvm::isa<llvm::InsertElementInst>(llvmValue) ||
+				 llvm::isa<llvm::ShuffleVectorInst>(llvmValue) );
+	}
 	DAGVertexList& getSuccessors() { 
 		// std::cout << "returning ssuccessors..." << std::endl;
 		return Successors; }
 	bool hasSuccessors() { return !Successors.empty(); }
-	// DAGVertexList Predecessors() { return Predecessors; }
+	DAGVertexList& getPredecessors() { return Predecessors; }
 	bool hasPredecessors() { return !Predecessors.empty(); }
 
 	void setVarWidth(int width) { varWidth = width; }
 	void setVarDepth(int depth) { varDepth = depth; }
 	void setOpWidth(int width) { opWidth = width; }
 	void setOpDepth(int depth) { opDepth = depth; }
+	void setLatency(int cycles) { latency = cycles; }
+	void setArea(int size) { area = size; }
+	void setUnitClass(unit_t unit) { unitClass = unit; }
+	void setBitWidth(unsigned bits, unsigned declared) { bitWidth = bits; declaredBits = declared; }
+	void setID(unsigned index) { id = index; }
+	void setCost(const OpCost &cost)
+	{
+		latency = cost.latency;
+		area = cost.area;
+		unitClass = cost.unit;
+	}
 	void setValueNode(DAGNode* node) { valueNode = node; }
 	void setConstName(std::string name) { constName = name; }
 
@@ -125,6 +174,12 @@ public:
 		return false;
 	}
 
+	void clearEdges()
+	{
+		Successors.clear();
+		Predecessors.clear();
+	}
+
 	bool removeSuccessor(DAGNode* successor)
 	{
 		if ( successor != nullptr || isSuccessorPresent(successor) ) 
@@ -135,6 +190,11 @@ public:
 		return false;
 	}
 
+	bool removePredecessor(DAGNode* predecessor)
+	{
+		return Predecessors.erase(predecessor) != 0;
+	}
+
 	bool hasStoredValue()
 	{
 		DAGNode* successor;
@@ -151,30 +211,6 @@ public:
 		return false;
 	}
 
-	void setVisited(bool status)
-	{
-		visited = status;
-	}
-
-	void setAllUnvisited()
-	{
-		visited = false;
-		DAGNode* successor;
-		for (auto successor_pair : Successors)
-		{
-			successor = successor_pair.second;
-			successor->setVisited(false);
-		}
-	}
-
-	bool hasBeenVisited()
-	{
-		if (visited == true)
-			return true;
-		else
-			return false;
-	}
-
 	DAGNode* getStoredValueNode()
 	{
 		DAGNode* successor;
@@ -223,6 +259,13 @@ public:
 	}
 
 	void print()
+	{
+		VisitMarks visited;
+		visited.visit(id);
+		print(visited);
+	}
+
+	void print(VisitMarks &visited)
 	{
 		if (type == INST)
 		{
@@ -230,7 +273,10 @@ public:
       		llvm::outs() << "\t  Instruction: " << inst->getOpcodeName();
       		llvm::outs() << " (" << getName() << ")";
       		llvm::outs() << "\n\t\t\t(Variable Width: " << varWidth << ")";
-      		llvm::outs() << " (Operator Width: " << opWidth << ")\n";
+      		llvm::outs() << " (Operator Width: " << opWidth << ")";
+      		llvm::outs() << "\n\t\t\t(Latency: " << latency << ")";
+      		llvm::outs() << " (Area: " << area << ")";
+      		llvm::outs() << " (Unit: " << CostModel::getUnitName(unitClass) << ")\n";
       		llvm::outs() << "\t\t\t(ID: " << &*llvmValue << ")\n";
 		}
 		else if (type == FUNC)
@@ -238,6 +284,11 @@ public:
 			llvm::outs() << "\tFunction Call: " << getName();
 			llvm::outs() << " (ID: " << &*llvmValue << ")\n";
 		}
+		else if (type == BRANCH)
+		{
+			llvm::outs() << "\t       Branch: " << getName();
+			llvm::outs() << " (ID: " << &*llvmValue << ")\n";
+		}
 		else
 		{
       		llvm::outs() << "\t        Value: " << getName();
@@ -251,16 +302,19 @@ public:
 		{
 			successor = successor_pair.second;
 			// to prevent an infinite loop mark as visited
-			if ( !successor->hasBeenVisited() )
-			{
-				successor->setVisited(true);
-				successor->print();
-			}
+			if ( visited.visit( successor->getID() ) )
+				successor->print(visited);
 		}
-		setAllUnvisited(); //reset visited status for next print call
 	}
 
 	void prettyPrint(int tabCountLeft=0, int tabCountRight=2, int biOpCount=0)
+	{
+		VisitMarks visited;
+		visited.visit(id);
+		prettyPrint(visited, tabCountLeft, tabCountRight, biOpCount);
+	}
+
+	void prettyPrint(VisitMarks &visited, int tabCountLeft, int tabCountRight, int biOpCount)
 	{
 		if (type == INST && llvm::isa<llvm::BinaryOperator>(llvmValue))
 		{
@@ -302,15 +356,14 @@ public:
 		{
 			successor = successor_pair.second;
 			// to prevent an infinite loop mark as visited
-			if ( successor->hasBeenVisited() )
+			if ( visited.visit( successor->getID() ) )
 			{
 				// if ( successor->hasSuccessors() )
 				// {
 				// 	tabCountLeft += 2;
 				// }
 				
-				successor->setVisited(false);
-				successor->prettyPrint(tabCountLeft+2*successorCount, tabCountRight, biOpCount);
+				successor->prettyPrint(visited, tabCountLeft+2*successorCount, tabCountRight, biOpCount);
 				successorCount++;
 			}
 		}
@@ -351,31 +404,34 @@ public:
 	}
 
 
-	bool DOTcreateNode(std::ostringstream &outSS, DAGNode* parentNode=nullptr)
+	/// Writer is a DOTWriter or a DOTBuffer
+	template <typename Writer>
+	bool DOTcreateNode(Writer &out)
 	{
 		// Declare node format:
-		//	nodeName[label = "<label>"];
-		auto nodeAddress = DOTnodeID();
-		outSS << "\t\t" << nodeAddress << "[label = \"" << getName() << "\"];" << std::endl;
-
-		// Link and add to graph
-		//	"parentNode"->"node";
-		if ( parentNode != nullptr)
-		{
-			outSS << "\t\t\"" << parentNode->DOTnodeID() << "\"->\"";
-			outSS << nodeAddress << "\";" << std::endl;  
-		}
+		//	nodeID[label = "<label>"];
+		out << "\t\t";
+		out.writeNumber(id) << "[label = \"";
+		if ( !constName.empty() )
+			out.writeEscaped(constName);
+		else if ( llvmValue->hasName() )
+			out.writeEscaped( llvmValue->getName() );
+		else
+			out << "<no name>";
+		out << "\"];\n";
 
 		return true;
 	}
 
-	std::string DOTnodeID()
+	template <typename Writer>
+	bool DOTcreateEdge(Writer &out, DAGNode* parentNode)
 	{
-		std::uintptr_t ptr_val = std::uintptr_t(&*llvmValue);
-		std::stringstream ss;
-		ss << std::dec << ptr_val;
+		//	parentNodeID->nodeID;
+		out << "\t\t";
+		out.writeNumber( parentNode->getID() ) << "->";
+		out.writeNumber(id) << ";\n";
 
-		return ss.str();
+		return true;
 	}
 
 };
@@ -0,0 +1,410 @@
+#ifndef DAG_SUMMARY_H
+#define DAG_SUMMARY_H
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+#include <vector>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/Analysis/LoopInfo.h>
+
+#include "DAGNode.h"
+#include "DOTWriter.h"
+
+typedef enum cluster_t{NO_CLUSTER, BLOCK_CLUSTER, LOOP_CLUSTER} cluster_t;
+
+/// How a summarized DOT file reduces the DAG
+struct DOTSummaryOptions
+{
+	bool enabled;
+	cluster_t cluster;		//group the nodes by basic block or innermost loop
+	bool collapseChains;	//one node per run of single-use dependences
+	bool foldIsomorphic;	//one node per set of structurally equal cones
+	unsigned topPaths;		//keep the K most critical paths (0 keeps all nodes)
+	unsigned maxNodes;		//then keep at most this many nodes (0 is no cap)
+
+	DOTSummaryOptions() : enabled(false), cluster(BLOCK_CLUSTER), collapseChains(true),
+		foldIsomorphic(true), topPaths(0), maxNodes(2000) {}
+};
+
+/**
+ * @brief DAGSummary
+ * Reduces a locked and scheduled DAG to a graph GraphViz can lay out in
+ * seconds while keeping what drives its width and depth:
+ *  1. keeps the top-K critical paths, then the nodes on the longest paths
+ *     up to the node cap;
+ *  2. folds nodes whose dependence cones are structurally equal (same
+ *     operators, constants ignored) within a cluster, e.g. unrolled
+ *     iterations, into one node marked with its count;
+ *  3. collapses linear chains into one node;
+ *  4. writes each basic block or loop as a DOT cluster, with the critical
+ *     path in red.
+ */
+class DAGSummary
+{
+private:
+	enum : unsigned { NONE = UINT_MAX };
+
+	std::vector<DAGNode*> &Nodes;
+	std::vector<int> &Level;
+	std::vector<int> &Finish;
+	std::vector<int> &After;
+	DOTSummaryOptions options;
+
+	std::vector<char> Kept;
+	std::vector<int> Cluster;		//-1 outside every cluster
+	std::vector<unsigned> Rep;		//folded representative of a kept node
+	std::vector<unsigned> Count;	//nodes folded into a representative
+	std::vector<unsigned> Chain;	//chain head of a representative
+	std::vector<unsigned> Next;		//next representative along a chain
+	std::vector<std::string> ClusterNames;
+	int criticalLength;
+
+public:
+	DAGSummary(std::vector<DAGNode*> &nodes, std::vector<int> &level, std::vector<int> &finish,
+			   std::vector<int> &after, const DOTSummaryOptions &options) :
+		Nodes(nodes), Level(level), Finish(finish), After(after), options(options), criticalLength(0)
+	{
+		for (auto length : Finish)
+			criticalLength = std::max(criticalLength, length);
+	}
+
+	bool write(DOTWriter &out, llvm::Function &function, llvm::LoopInfo *LI)
+	{
+		selectNodes();
+		assignClusters(function, LI);
+		foldIsomorphic();
+		collapseChains();
+		return writeDOT(out, function.getName());
+	}
+
+	/// Nodes written to the summary
+	size_t getSummaryNodeCount()
+	{
+		size_t heads = 0;
+		for (size_t id = 0; id < Nodes.size(); ++id)
+		{
+			if ( Kept[id] && Rep[id] == id && Chain[id] == id )
+				heads++;
+		}
+		return heads;
+	}
+
+private:
+	void selectNodes()
+	{
+		size_t nodeCount = Nodes.size();
+		Kept.assign(nodeCount, options.topPaths == 0);
+
+		// trace a critical path down from each of the K latest roots,
+		// always through the dependence that finishes last
+		if ( options.topPaths != 0 )
+		{
+			std::vector<unsigned> roots;
+			for (auto node : Nodes)
+			{
+				if ( !node->hasPredecessors() )
+					roots.push_back( node->getID() );
+			}
+			std::stable_sort(roots.begin(), roots.end(), [this](unsigned a, unsigned b) {
+				return Finish[a] > Finish[b];
+			});
+			if ( roots.size() > options.topPaths )
+				roots.resize(options.topPaths);
+
+			for (auto id : roots)
+			{
+				while ( id != NONE )
+				{
+					Kept[id] = true;
+					unsigned next = NONE;
+					for (auto successor_pair : Nodes[id]->getSuccessors())
+					{
+						auto successorID = successor_pair.second->getID();
+						if ( next == NONE || Finish[successorID] > Finish[next] )
+							next = successorID;
+					}
+					id = next;
+				}
+			}
+		}
+
+		// over the cap, keep the nodes on the longest paths
+		std::vector<unsigned> kept;
+		for (unsigned id = 0; id < nodeCount; ++id)
+		{
+			if ( Kept[id] )
+				kept.push_back(id);
+		}
+		if ( options.maxNodes != 0 && kept.size() > options.maxNodes )
+		{
+			std::stable_sort(kept.begin(), kept.end(), [this](unsigned a, unsigned b) {
+				return Finish[a] + After[a] > Finish[b] + After[b];
+			});
+			for (size_t i = options.maxNodes; i < kept.size(); ++i)
+				Kept[ kept[i] ] = false;
+		}
+	}
+
+	void assignClusters(llvm::Function &function, llvm::LoopInfo *LI)
+	{
+		std::map<const llvm::BasicBlock*, int> BlockCluster;
+		std::map<const llvm::Loop*, int> LoopCluster;
+		unsigned blockIndex = 0;
+		for (auto blockIter=function.begin(); blockIter!=function.end(); ++blockIter, ++blockIndex)
+		{
+			const llvm::BasicBlock *BB = &*blockIter;
+			if ( options.cluster == BLOCK_CLUSTER )
+			{
+				BlockCluster[BB] = ClusterNames.size();
+				ClusterNames.push_back( BB->hasName() ? BB->getName().str() : "bb" + std::to_string(blockIndex) );
+				continue;
+			}
+
+			auto loop = LI ? LI->getLoopFor(BB) : nullptr;
+			if ( loop == nullptr )
+				continue;
+			if ( LoopCluster.count(loop) == 0 )
+			{
+				auto header = loop->getHeader();
+				std::string headerName = header->hasName() ? header->getName().str() : std::to_string(LoopCluster.size());
+				ClusterNames.push_back( "loop " + headerName + " (depth " + std::to_string(loop->getLoopDepth()) + ")" );
+				LoopCluster[loop] = ClusterNames.size() - 1;
+			}
+			BlockCluster[BB] = LoopCluster[loop];
+		}
+
+		Cluster.assign(Nodes.size(), -1);
+		if ( options.cluster == NO_CLUSTER )
+			return;
+		for (auto node : Nodes)
+		{
+			auto inst = llvm::dyn_cast<llvm::Instruction>(node->getllvmValue());
+			if ( inst == nullptr )
+				continue;
+			auto found = BlockCluster.find( inst->getParent() );
+			if ( found != BlockCluster.end() )
+				Cluster[node->getID()] = found->second;
+		}
+	}
+
+	/// Hash of each kept node's cone of dependences, bottom-up, then one
+	/// representative per (hash, cluster)
+	void foldIsomorphic()
+	{
+		size_t nodeCount = Nodes.size();
+		Rep.assign(nodeCount, NONE);
+		Count.assign(nodeCount, 0);
+		std::vector<size_t> Hash(nodeCount, 0);
+		std::map< std::pair<size_t, int>, unsigned > FirstOf;
+
+		for (auto id : byLevel(true))
+		{
+			if ( !Kept[id] )
+				continue;
+			auto node = Nodes[id];
+			std::vector<size_t> successorHashes;
+			for (auto successor_pair : node->getSuccessors())
+			{
+				auto successorID = successor_pair.second->getID();
+				if ( Kept[successorID] )
+					successorHashes.push_back( Hash[successorID] );
+			}
+			std::sort(successorHashes.begin(), successorHashes.end());
+			Hash[id] = llvm::hash_combine( getKind(node), node->getLatency(),
+				llvm::hash_combine_range(successorHashes.begin(), successorHashes.end()) );
+
+			// leaves (constants, arguments) keep their identity, only the
+			// cones above them fold
+			Rep[id] = id;
+			if ( options.foldIsomorphic && !successorHashes.empty() )
+				Rep[id] = FirstOf.insert( std::make_pair(std::make_pair(Hash[id], Cluster[id]), id) ).first->second;
+			Count[ Rep[id] ]++;
+		}
+	}
+
+	/// A representative with one dependence, on a representative with one
+	/// dependent in the same cluster, continues that chain
+	void collapseChains()
+	{
+		size_t nodeCount = Nodes.size();
+		std::vector< std::set<unsigned> > Out(nodeCount), In(nodeCount);
+		forEachEdge([&](unsigned from, unsigned to) {
+			Out[from].insert(to);
+			In[to].insert(from);
+		});
+
+		Next.assign(nodeCount, NONE);
+		Chain.assign(nodeCount, NONE);
+		for (unsigned id = 0; id < nodeCount; ++id)
+		{
+			if ( !Kept[id] || Rep[id] != id || !options.collapseChains )
+				continue;
+			if ( Out[id].size() == 1 )
+			{
+				auto next = *Out[id].begin();
+				if ( In[next].size() == 1 && Cluster[next] == Cluster[id] && Count[next] == Count[id] )
+					Next[id] = next;
+			}
+		}
+		for (unsigned id = 0; id < nodeCount; ++id)
+		{
+			if ( !Kept[id] || Rep[id] != id )
+				continue;
+			bool isHead = In[id].size() != 1 || Next[ *In[id].begin() ] != id;
+			if ( !isHead )
+				continue;
+			for (auto member = id; member != NONE; member = Next[member])
+				Chain[member] = id;
+		}
+	}
+
+	bool writeDOT(DOTWriter &out, llvm::StringRef functionName)
+	{
+		// group the chain heads by cluster
+		std::map< int, std::vector<unsigned> > Members;
+		for (unsigned id = 0; id < Nodes.size(); ++id)
+		{
+			if ( Kept[id] && Rep[id] == id && Chain[id] == id )
+				Members[ Cluster[id] ].push_back(id);
+		}
+
+		out << "digraph g{\n";
+		out << "\tnode [shape = box,height = .1];\n\n";
+		out << "\tlabelloc = \"t\";\n";
+		out << "\tlabel = \"";
+		out.writeEscaped(functionName);
+		out << "_DAG (summary of ";
+		out.writeNumber( Nodes.size() ) << " nodes)\";\n\n";
+
+		for (auto &cluster : Members)
+		{
+			if ( cluster.first >= 0 )
+			{
+				out << "\tsubgraph cluster_";
+				out.writeNumber(cluster.first) << " {\n\t\tlabel = \"";
+				out.writeEscaped( ClusterNames[cluster.first] );
+				out << "\";\n";
+			}
+			for (auto head : cluster.second)
+				writeNode(out, head);
+			if ( cluster.first >= 0 )
+				out << "\t}\n";
+		}
+
+		std::set< std::pair<unsigned, unsigned> > Edges;
+		forEachEdge([&](unsigned from, unsigned to) {
+			if ( Chain[from] != Chain[to] )
+				Edges.insert( std::make_pair(Chain[from], Chain[to]) );
+		});
+		for (auto edge : Edges)
+		{
+			out << "\t";
+			out.writeNumber(edge.first) << "->";
+			out.writeNumber(edge.second);
+			if ( isCritical(edge.first) && isCritical(edge.second) )
+				out << " [color = red]";
+			out << ";\n";
+		}
+		out << "}\n";
+		return true;
+	}
+
+	void writeNode(DOTWriter &out, unsigned head)
+	{
+		unsigned length = 0, tail = head;
+		for (auto member = head; member != NONE; member = Next[member])
+		{
+			length++;
+			tail = member;
+		}
+
+		out << "\t\t";
+		out.writeNumber(head) << "[label = \"";
+		writeLabel(out, Nodes[head]);
+		if ( length > 1 )
+		{
+			out << " .. ";
+			writeLabel(out, Nodes[tail]);
+			out << "\\n(";
+			out.writeNumber(length) << " nodes)";
+		}
+		if ( Count[head] > 1 )
+		{
+			out << " x";
+			out.writeNumber( Count[head] );
+		}
+		out << "\"";
+		if ( isCritical(head) )
+			out << ", color = red";
+		out << "];\n";
+	}
+
+	void writeLabel(DOTWriter &out, DAGNode *node)
+	{
+		auto value = node->getllvmValue();
+		if ( node->getType() == INST )
+		{
+			out << llvm::cast<llvm::Instruction>(value)->getOpcodeName() << " ";
+		}
+		if ( !node->getConstName().empty() )
+			out.writeEscaped( node->getConstName() );
+		else if ( value->hasName() )
+			out.writeEscaped( value->getName() );
+		else
+			out << "<no name>";
+	}
+
+	/// A summary node lies on a critical path when one of its members does
+	bool isCritical(unsigned head)
+	{
+		for (auto member = head; member != NONE; member = Next[member])
+		{
+			if ( Finish[member] + After[member] == criticalLength )
+				return true;
+		}
+		return false;
+	}
+
+	/// Calls visit(from, to) for each edge between kept nodes, mapped onto
+	/// their representatives
+	template <typename Visitor>
+	void forEachEdge(Visitor visit)
+	{
+		for (auto node : Nodes)
+		{
+			auto id = node->getID();
+			if ( !Kept[id] )
+				continue;
+			for (auto successor_pair : node->getSuccessors())
+			{
+				auto successorID = successor_pair.second->getID();
+				if ( Kept[successorID] && Rep[id] != Rep[successorID] )
+					visit(Rep[id], Rep[successorID]);
+			}
+		}
+	}
+
+	/// Node IDs ordered so that dependences come first (ascending) or last
+	std::vector<unsigned> byLevel(bool ascending)
+	{
+		std::vector<unsigned> order( Nodes.size() );
+		for (unsigned id = 0; id < order.size(); ++id)
+			order[id] = id;
+		std::stable_sort(order.begin(), order.end(), [this, ascending](unsigned a, unsigned b) {
+			return ascending ? Level[a] < Level[b] : Level[a] > Level[b];
+		});
+		return order;
+	}
+
+	static size_t getKind(DAGNode *node)
+	{
+		auto value = node->getllvmValue();
+		auto inst = llvm::dyn_cast<llvm::Instruction>(value);
+		size_t opcode = inst ? inst->getOpcode() : (llvm::isa<llvm::Constant>(value) ? 0 : 1);
+		return llvm::hash_combine( (int)node->getType(), opcode );
+	}
+};
+
+#endif /* DAG_SUMMARY_H */
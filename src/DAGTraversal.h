@@ -0,0 +1,328 @@
+#ifndef DAG_TRAVERSAL_H
+#define DAG_TRAVERSAL_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "DAGNode.h"
+#include "DOTWriter.h"
+#include "FrontierKernels.h"
+#include "WorkerPool.h"
+
+/**
+ * @brief DAGVisitor
+ * Plugs into a DAGTraversal. Levels are visited in order and every
+ * dependence of a node lies on an earlier, finished level. The chunks of
+ * one level may be visited concurrently by different workers.
+ */
+class DAGVisitor
+{
+public:
+	virtual ~DAGVisitor() {}
+
+	/// Serially, before the level's chunkCount chunks
+	virtual void beginLevel(unsigned level, size_t chunkCount) {}
+
+	/// Nodes ids[0 .. count) form chunk number chunk of the level
+	virtual void visit(unsigned level, const unsigned *ids, size_t count, size_t chunk, unsigned worker) = 0;
+
+	/// Serially, after every chunk of the level
+	virtual void endLevel(unsigned level) {}
+};
+
+
+/**
+ * @brief DAGTraversal
+ * Level-synchronous topological traversal of a locked DAG, dependences
+ * first (level 1 holds the nodes without dependences). The edges are
+ * copied into CSR arrays indexed by node ID. Serially, the frontiers are
+ * formed with the FrontierKernels; on a larger pool each level is split
+ * into chunks that workers take with work stealing, the dependence
+ * counts are decremented atomically and every worker collects the nodes
+ * it made ready in its own buffer. Each frontier is sorted by ID, so the
+ * order and the visitors' results do not depend on the thread count.
+ */
+class DAGTraversal
+{
+public:
+	enum : size_t { ChunkSize = 1024 };
+
+private:
+	std::vector<DAGNode*> &Nodes;
+	std::vector<uint64_t> DependenceStart, DependentStart;
+	std::vector<uint32_t> Dependences, Dependents;
+	std::vector<unsigned> Order;	//node IDs by level
+	std::vector<size_t> LevelStart;	//Order index of each level's first node
+
+public:
+	DAGTraversal(std::vector<DAGNode*> &nodes) : Nodes(nodes)
+	{
+		size_t nodeCount = Nodes.size();
+		DependenceStart.assign(nodeCount + 1, 0);
+		DependentStart.assign(nodeCount + 1, 0);
+		for (auto node : Nodes)
+		{
+			auto id = node->getID();
+			DependenceStart[id+1] = DependenceStart[id] + node->getSuccessors().size();
+			DependentStart[id+1] = DependentStart[id] + node->getPredecessors().size();
+		}
+		Dependences.resize( DependenceStart[nodeCount] );
+		Dependents.resize( DependentStart[nodeCount] );
+		for (auto node : Nodes)
+		{
+			auto fill = DependenceStart[node->getID()];
+			for (auto successor_pair : node->getSuccessors())
+				Dependences[fill++] = successor_pair.second->getID();
+			fill = DependentStart[node->getID()];
+			for (auto predecessor_pair : node->getPredecessors())
+				Dependents[fill++] = predecessor_pair.second->getID();
+		}
+	}
+
+	const uint32_t* dependencesBegin(unsigned id) { return Dependences.data() + DependenceStart[id]; }
+	const uint32_t* dependencesEnd(unsigned id) { return Dependences.data() + DependenceStart[id+1]; }
+	const uint32_t* dependentsBegin(unsigned id) { return Dependents.data() + DependentStart[id]; }
+	const uint32_t* dependentsEnd(unsigned id) { return Dependents.data() + DependentStart[id+1]; }
+
+	/// Node IDs of level l are Order[LevelStart[l] .. LevelStart[l+1]),
+	/// from the last run(); Order only holds the visited nodes
+	std::vector<unsigned>& getOrder() { return Order; }
+	std::vector<size_t>& getLevelStart() { return LevelStart; }
+
+	/// False if a cycle left nodes unvisited
+	bool run(std::vector<DAGVisitor*> &visitors, WorkerPool &pool)
+	{
+		auto &kernels = FrontierKernels::get();
+		size_t nodeCount = Nodes.size();
+		bool parallel = pool.size() > 1;
+
+		std::vector<int32_t> pending(nodeCount);
+		for (size_t id = 0; id < nodeCount; ++id)
+			pending[id] = DependenceStart[id+1] - DependenceStart[id];
+		std::unique_ptr< std::atomic<int32_t>[] > atomicPending;
+		if ( parallel )
+		{
+			atomicPending.reset( new std::atomic<int32_t>[nodeCount] );
+			for (size_t id = 0; id < nodeCount; ++id)
+				atomicPending[id].store(pending[id], std::memory_order_relaxed);
+		}
+		std::vector< std::vector<uint32_t> > Ready( pool.size() );
+		std::vector<uint32_t> edges;
+
+		Order.assign(nodeCount + FrontierKernels::Padding, 0);
+		LevelStart.assign(2, 0);
+		size_t frontierBegin = 0;
+		size_t frontierEnd = kernels.selectZero(pending.data(), nodeCount, Order.data());
+		while ( frontierBegin != frontierEnd )
+		{
+			unsigned level = LevelStart.size() - 1;
+			LevelStart.push_back(frontierEnd);
+			const unsigned *frontier = &Order[frontierBegin];
+			size_t frontierSize = frontierEnd - frontierBegin;
+			size_t chunkCount = (frontierSize + ChunkSize - 1) / ChunkSize;
+			for (auto visitor : visitors)
+				visitor->beginLevel(level, chunkCount);
+
+			size_t readyCount = 0;
+			if ( !parallel )
+			{
+				edges.clear();
+				for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+				{
+					size_t begin = chunk * ChunkSize, count = std::min<size_t>(ChunkSize, frontierSize - begin);
+					for (auto visitor : visitors)
+						visitor->visit(level, frontier + begin, count, chunk, 0);
+					for (size_t i = begin; i < begin + count; ++i)
+						edges.insert( edges.end(), dependentsBegin(frontier[i]), dependentsEnd(frontier[i]) );
+				}
+				readyCount = kernels.decrement(pending.data(), edges.data(), edges.size(), &Order[frontierEnd]);
+			}
+			else
+			{
+				auto process = [&](size_t firstChunk, size_t lastChunk, unsigned worker) {
+					for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+					{
+						size_t begin = chunk * ChunkSize, count = std::min<size_t>(ChunkSize, frontierSize - begin);
+						for (auto visitor : visitors)
+							visitor->visit(level, frontier + begin, count, chunk, worker);
+						for (size_t i = begin; i < begin + count; ++i)
+						{
+							for (auto dependent = dependentsBegin(frontier[i]); dependent != dependentsEnd(frontier[i]); ++dependent)
+							{
+								if ( atomicPending[*dependent].fetch_sub(1, std::memory_order_acq_rel) == 1 )
+									Ready[worker].push_back(*dependent);
+							}
+						}
+					}
+				};
+				// a single chunk is not worth waking the pool for
+				if ( chunkCount == 1 )
+					process(0, 1, 0);
+				else
+					pool.parallelSteal(chunkCount, 1, process);
+
+				for (auto &ready : Ready)
+				{
+					std::copy( ready.begin(), ready.end(), Order.begin() + frontierEnd + readyCount );
+					readyCount += ready.size();
+					ready.clear();
+				}
+			}
+			std::sort( Order.begin() + frontierEnd, Order.begin() + frontierEnd + readyCount );
+
+			for (auto visitor : visitors)
+				visitor->endLevel(level);
+			frontierBegin = frontierEnd;
+			frontierEnd += readyCount;
+		}
+
+		Order.resize(frontierEnd);
+		return frontierEnd == nodeCount;
+	}
+};
+
+
+/// Records the ASAP level of each node ID
+class LevelVisitor : public DAGVisitor
+{
+private:
+	std::vector<int> &Level;
+
+public:
+	LevelVisitor(std::vector<int> &level) : Level(level) {}
+
+	void visit(unsigned level, const unsigned *ids, size_t count, size_t chunk, unsigned worker)
+	{
+		for (size_t i = 0; i < count; ++i)
+			Level[ ids[i] ] = level;
+	}
+};
+
+
+/// Counts the value lanes of each level (the level histogram of the
+/// width): one per scalar value node, flagged for the countFlagged kernel,
+/// or the lanes of each value node once the DAG holds vectors
+class ValueWidthVisitor : public DAGVisitor
+{
+private:
+	std::vector<uint8_t> IsValue;	//padded for FrontierKernels::countFlagged
+	std::vector<uint32_t> Lanes;	//empty for a scalar DAG
+	std::vector<size_t> ChunkCounts;
+	std::vector<int> &ValuesPerLevel;
+
+public:
+	ValueWidthVisitor(std::vector<DAGNode*> &nodes, std::vector<int> &valuesPerLevel) :
+		IsValue(nodes.size() + 3, 0), ValuesPerLevel(valuesPerLevel)
+	{
+		for (auto node : nodes)
+		{
+			if ( node->getType() != VAL )
+				continue;
+			IsValue[ node->getID() ] = 1;
+			if ( node->getLanes() != 1 && Lanes.empty() )
+				Lanes.assign(nodes.size(), 0);
+		}
+		if ( !Lanes.empty() )
+		{
+			for (auto node : nodes)
+				Lanes[ node->getID() ] = node->getType() == VAL ? node->getLanes() : 0;
+		}
+		ValuesPerLevel.assign(1, 0);
+	}
+
+	void beginLevel(unsigned level, size_t chunkCount)
+	{
+		ChunkCounts.assign(chunkCount, 0);
+	}
+
+	void visit(unsigned level, const unsigned *ids, size_t count, size_t chunk, unsigned worker)
+	{
+		if ( Lanes.empty() )
+		{
+			ChunkCounts[chunk] = FrontierKernels::get().countFlagged(IsValue.data(), ids, count);
+			return;
+		}
+		size_t lanes = 0;
+		for (size_t i = 0; i < count; ++i)
+			lanes += Lanes[ ids[i] ];
+		ChunkCounts[chunk] = lanes;
+	}
+
+	void endLevel(unsigned level)
+	{
+		size_t values = 0;
+		for (auto chunkCount : ChunkCounts)
+			values += chunkCount;
+		ValuesPerLevel.push_back(values);
+	}
+};
+
+
+/// ASAP finish time (cycles) of each node ID: its latency after the
+/// latest of its dependences
+class FinishTimeVisitor : public DAGVisitor
+{
+private:
+	std::vector<DAGNode*> &Nodes;
+	DAGTraversal &Traversal;
+	std::vector<int> &Finish;
+
+public:
+	FinishTimeVisitor(std::vector<DAGNode*> &nodes, DAGTraversal &traversal, std::vector<int> &finish) :
+		Nodes(nodes), Traversal(traversal), Finish(finish) {}
+
+	void visit(unsigned level, const unsigned *ids, size_t count, size_t chunk, unsigned worker)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			int start = 0;
+			for (auto dependence = Traversal.dependencesBegin(ids[i]); dependence != Traversal.dependencesEnd(ids[i]); ++dependence)
+				start = std::max(start, Finish[*dependence]);
+			Finish[ ids[i] ] = start + Nodes[ ids[i] ]->getLatency();
+		}
+	}
+};
+
+
+/// Renders the nodes and edges of each chunk in parallel and writes a
+/// level's chunks in order, so the DOT file is the same for any pool
+class DOTVisitor : public DAGVisitor
+{
+private:
+	std::vector<DAGNode*> &Nodes;
+	DOTWriter &Out;
+	std::vector<DOTBuffer> Chunks;
+
+public:
+	DOTVisitor(std::vector<DAGNode*> &nodes, DOTWriter &out) : Nodes(nodes), Out(out) {}
+
+	void beginLevel(unsigned level, size_t chunkCount)
+	{
+		Chunks.resize(chunkCount);
+		for (auto &chunk : Chunks)
+			chunk.clear();
+	}
+
+	void visit(unsigned level, const unsigned *ids, size_t count, size_t chunk, unsigned worker)
+	{
+		for (size_t i = 0; i < count; ++i)
+			render(Chunks[chunk], Nodes[ ids[i] ]);
+	}
+
+	void endLevel(unsigned level)
+	{
+		for (auto &chunk : Chunks)
+			Out.write(chunk.data(), chunk.size());
+	}
+
+	static void render(DOTBuffer &chunk, DAGNode *node)
+	{
+		node->DOTcreateNode(chunk);
+		for (auto successor_pair : node->getSuccessors())
+			successor_pair.second->DOTcreateEdge(chunk, node);
+	}
+};
+
+#endif /* DAG_TRAVERSAL_H */
@@ -0,0 +1,189 @@
+#ifndef DOT_WRITER_H
+#define DOT_WRITER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <llvm/ADT/StringRef.h>
+
+/**
+ * @brief DOTWriter
+ * Streams text to a file descriptor through a fixed-size buffer, so a
+ * graph of any size is written in constant memory. Used for the DOT,
+ * SVG and binary DAG exports. Integers are formatted
+ * in place, without allocating.
+ */
+class DOTWriter
+{
+private:
+	static const size_t BufferSize = 1 << 16;
+
+	char Buffer[BufferSize];
+	size_t used;
+	int fd;
+	bool failed;
+
+public:
+	DOTWriter() : used(0), fd(-1), failed(false) {}
+	~DOTWriter() { close(); }
+
+	bool open(const std::string &filePath)
+	{
+		close();
+		fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		used = 0;
+		failed = (fd < 0);
+		return !failed;
+	}
+
+	/// Flushes and closes the file, false if any write failed
+	bool close()
+	{
+		if ( fd < 0 )
+			return !failed;
+		flush();
+		if ( ::close(fd) != 0 )
+			failed = true;
+		fd = -1;
+		return !failed;
+	}
+
+	DOTWriter& operator<<(char c)
+	{
+		if ( used == BufferSize )
+			flush();
+		Buffer[used++] = c;
+		return *this;
+	}
+
+	DOTWriter& operator<<(llvm::StringRef text)
+	{
+		write(text.data(), text.size());
+		return *this;
+	}
+
+	DOTWriter& operator<<(const char *text)
+	{
+		write(text, std::strlen(text));
+		return *this;
+	}
+
+	DOTWriter& writeNumber(uint64_t number)
+	{
+		char digits[20];
+		size_t count = 0;
+		do {
+			digits[count++] = '0' + number % 10;
+			number /= 10;
+		} while ( number != 0 );
+		while ( count != 0 )
+			*this << digits[--count];
+		return *this;
+	}
+
+	/// Writes text as the inside of a quoted DOT string
+	void writeEscaped(llvm::StringRef text)
+	{
+		for (auto c : text)
+		{
+			if ( c == '"' || c == '\\' )
+				*this << '\\';
+			*this << c;
+		}
+	}
+
+	void write(const char *text, size_t size)
+	{
+		while ( size != 0 )
+		{
+			if ( used == BufferSize )
+				flush();
+			size_t count = std::min(size, BufferSize - used);
+			std::memcpy(Buffer + used, text, count);
+			used += count;
+			text += count;
+			size -= count;
+		}
+	}
+
+private:
+	void flush()
+	{
+		size_t written = 0;
+		while ( written < used && !failed )
+		{
+			ssize_t result = ::write(fd, Buffer + written, used - written);
+			if ( result < 0 && errno == EINTR )
+				continue;
+			if ( result <= 0 )
+				failed = true;
+			else
+				written += result;
+		}
+		used = 0;
+	}
+};
+
+
+/**
+ * @brief DOTBuffer
+ * In-memory counterpart of DOTWriter with the same interface, for text
+ * rendered in parallel and written out in order.
+ */
+class DOTBuffer
+{
+private:
+	std::string Text;
+
+public:
+	DOTBuffer& operator<<(char c)
+	{
+		Text += c;
+		return *this;
+	}
+
+	DOTBuffer& operator<<(llvm::StringRef text)
+	{
+		Text.append(text.data(), text.size());
+		return *this;
+	}
+
+	DOTBuffer& operator<<(const char *text)
+	{
+		Text += text;
+		return *this;
+	}
+
+	DOTBuffer& writeNumber(uint64_t number)
+	{
+		char digits[20];
+		size_t count = 0;
+		do {
+			digits[count++] = '0' + number % 10;
+			number /= 10;
+		} while ( number != 0 );
+		while ( count != 0 )
+			Text += digits[--count];
+		return *this;
+	}
+
+	void writeEscaped(llvm::StringRef text)
+	{
+		for (auto c : text)
+		{
+			if ( c == '"' || c == '\\' )
+				Text += '\\';
+			Text += c;
+		}
+	}
+
+	void clear() { Text.clear(); }
+	const char* data() const { return Text.data(); }
+	size_t size() const { return Text.size(); }
+};
+
+#endif /* DOT_WRITER_H */
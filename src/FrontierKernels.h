@@ -0,0 +1,289 @@
+#ifndef FRONTIER_KERNELS_H
+#define FRONTIER_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FRONTIER_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+typedef enum simd_t{SCALAR_SIMD, AVX2_SIMD, AVX512_SIMD} simd_t;
+
+/**
+ * @brief FrontierKernels
+ * Bulk array operations of the level-synchronous schedule (see
+ * DAGBuilder::findSchedule) in scalar, AVX2 and AVX-512 versions. The
+ * widest version the CPU supports is picked at runtime and may be lowered
+ * with select(). Every version returns the same results in the same order.
+ *
+ * AVX2 has no scatter, so its decrement is the scalar one; AVX-512 uses
+ * gather/scatter on blocks of distinct targets (checked with the conflict
+ * detection instructions) and falls back to scalar for blocks that repeat
+ * a target.
+ */
+class FrontierKernels
+{
+public:
+	/// Output arrays must have room for this many entries past the results
+	static const size_t Padding = 16;
+
+	/// Decrements counts[t] for each t of targets and appends the targets
+	/// that reach zero to ready; returns how many were appended
+	typedef size_t (*DecrementFn)(int32_t *counts, const uint32_t *targets, size_t n, uint32_t *ready);
+	/// Appends every i < n with counts[i] == 0 to out (stream compaction)
+	typedef size_t (*SelectZeroFn)(const int32_t *counts, size_t n, uint32_t *out);
+	/// Number of ids with a non-zero flag (a level histogram bin); flags
+	/// must be readable 3 bytes past the largest id
+	typedef size_t (*CountFlaggedFn)(const uint8_t *flags, const uint32_t *ids, size_t n);
+
+	DecrementFn decrement;
+	SelectZeroFn selectZero;
+	CountFlaggedFn countFlagged;
+
+	static FrontierKernels& get()
+	{
+		static FrontierKernels kernels;
+		return kernels;
+	}
+
+	simd_t getLevel() { return level; }
+
+	/// False if the CPU does not support the level
+	bool select(simd_t requested)
+	{
+		if ( requested > getSupportedLevel() )
+			return false;
+		level = requested;
+		decrement = &decrementScalar;
+		selectZero = &selectZeroScalar;
+		countFlagged = &countFlaggedScalar;
+#ifdef FRONTIER_KERNELS_X86
+		if ( level == AVX2_SIMD )
+		{
+			selectZero = &selectZeroAVX2;
+			countFlagged = &countFlaggedAVX2;
+		}
+		if ( level == AVX512_SIMD )
+		{
+			decrement = &decrementAVX512;
+			selectZero = &selectZeroAVX512;
+			countFlagged = &countFlaggedAVX512;
+		}
+#endif
+		return true;
+	}
+
+	static simd_t getSupportedLevel()
+	{
+#ifdef FRONTIER_KERNELS_X86
+		__builtin_cpu_init();
+		if ( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") )
+			return AVX512_SIMD;
+		if ( __builtin_cpu_supports("avx2") )
+			return AVX2_SIMD;
+#endif
+		return SCALAR_SIMD;
+	}
+
+	static const char* getName(simd_t level)
+	{
+		switch ( level ) {
+			case (AVX512_SIMD):	return "avx512";
+			case (AVX2_SIMD):	return "avx2";
+			default:			return "scalar";
+		}
+	}
+
+	/// Parses "auto", "avx512", "avx2" or "scalar"
+	static bool parseLevel(std::string name, simd_t &level)
+	{
+		if ( name == "auto" )
+			level = getSupportedLevel();
+		else if ( name == "avx512" )
+			level = AVX512_SIMD;
+		else if ( name == "avx2" )
+			level = AVX2_SIMD;
+		else if ( name == "scalar" )
+			level = SCALAR_SIMD;
+		else
+			return false;
+		return true;
+	}
+
+private:
+	simd_t level;
+
+	FrontierKernels() { select( getSupportedLevel() ); }
+	FrontierKernels(const FrontierKernels&) = delete;
+	FrontierKernels& operator=(const FrontierKernels&) = delete;
+
+	static size_t decrementScalar(int32_t *counts, const uint32_t *targets, size_t n, uint32_t *ready)
+	{
+		size_t readyCount = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			if ( --counts[targets[i]] == 0 )
+				ready[readyCount++] = targets[i];
+		}
+		return readyCount;
+	}
+
+	static size_t selectZeroScalar(const int32_t *counts, size_t n, uint32_t *out)
+	{
+		size_t selected = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			if ( counts[i] == 0 )
+				out[selected++] = i;
+		}
+		return selected;
+	}
+
+	static size_t countFlaggedScalar(const uint8_t *flags, const uint32_t *ids, size_t n)
+	{
+		size_t flagged = 0;
+		for (size_t i = 0; i < n; ++i)
+			flagged += flags[ids[i]] != 0;
+		return flagged;
+	}
+
+#ifdef FRONTIER_KERNELS_X86
+	/// Lane permutations that pack the lanes set in an 8-bit mask to the front
+	struct PackTable
+	{
+		uint32_t lanes[256][8];
+
+		PackTable()
+		{
+			for (unsigned mask = 0; mask < 256; ++mask)
+			{
+				unsigned lane = 0;
+				for (unsigned bit = 0; bit < 8; ++bit)
+				{
+					if ( mask & (1u << bit) )
+						lanes[mask][lane++] = bit;
+				}
+				while ( lane < 8 )
+					lanes[mask][lane++] = 0;
+			}
+		}
+	};
+
+	__attribute__((target("avx2")))
+	static size_t selectZeroAVX2(const int32_t *counts, size_t n, uint32_t *out)
+	{
+		static const PackTable pack;
+		size_t selected = 0, i = 0;
+		__m256i zero = _mm256_setzero_si256();
+		__m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256i values = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(counts + i) );
+			unsigned mask = _mm256_movemask_ps( _mm256_castsi256_ps(_mm256_cmpeq_epi32(values, zero)) );
+			if ( mask == 0 )
+				continue;
+			__m256i ids = _mm256_add_epi32( lanes, _mm256_set1_epi32((int)i) );
+			__m256i order = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pack.lanes[mask]) );
+			_mm256_storeu_si256( reinterpret_cast<__m256i*>(out + selected), _mm256_permutevar8x32_epi32(ids, order) );
+			selected += __builtin_popcount(mask);
+		}
+		return selected + selectZeroScalarFrom(counts, i, n, out + selected);
+	}
+
+	__attribute__((target("avx2")))
+	static size_t countFlaggedAVX2(const uint8_t *flags, const uint32_t *ids, size_t n)
+	{
+		size_t i = 0;
+		__m256i zero = _mm256_setzero_si256();
+		__m256i lowByte = _mm256_set1_epi32(0xFF);
+		__m256i flagged = _mm256_setzero_si256();
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256i index = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(ids + i) );
+			__m256i bytes = _mm256_i32gather_epi32( reinterpret_cast<const int*>(flags), index, 1 );
+			bytes = _mm256_and_si256(bytes, lowByte);
+			// a set flag compares to -1
+			flagged = _mm256_sub_epi32( flagged, _mm256_cmpgt_epi32(bytes, zero) );
+		}
+		uint32_t lanes[8];
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>(lanes), flagged );
+		size_t total = 0;
+		for (auto lane : lanes)
+			total += lane;
+		return total + countFlaggedScalar(flags, ids + i, n - i);
+	}
+
+	__attribute__((target("avx512f,avx512cd")))
+	static size_t decrementAVX512(int32_t *counts, const uint32_t *targets, size_t n, uint32_t *ready)
+	{
+		size_t readyCount = 0, i = 0;
+		__m512i one = _mm512_set1_epi32(1);
+		__m512i zero = _mm512_setzero_si512();
+		for (; i + 16 <= n; i += 16)
+		{
+			__m512i index = _mm512_loadu_si512(targets + i);
+			__m512i conflicts = _mm512_conflict_epi32(index);
+			if ( _mm512_test_epi32_mask(conflicts, conflicts) != 0 )
+			{
+				readyCount += decrementScalar(counts, targets + i, 16, ready + readyCount);
+				continue;
+			}
+			__m512i values = _mm512_sub_epi32( _mm512_i32gather_epi32(index, counts, 4), one );
+			_mm512_i32scatter_epi32(counts, index, values, 4);
+			__mmask16 reached = _mm512_cmpeq_epi32_mask(values, zero);
+			_mm512_mask_compressstoreu_epi32(ready + readyCount, reached, index);
+			readyCount += __builtin_popcount(reached);
+		}
+		return readyCount + decrementScalar(counts, targets + i, n - i, ready + readyCount);
+	}
+
+	__attribute__((target("avx512f")))
+	static size_t selectZeroAVX512(const int32_t *counts, size_t n, uint32_t *out)
+	{
+		size_t selected = 0, i = 0;
+		__m512i zero = _mm512_setzero_si512();
+		__m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		for (; i + 16 <= n; i += 16)
+		{
+			__mmask16 mask = _mm512_cmpeq_epi32_mask( _mm512_loadu_si512(counts + i), zero );
+			if ( mask == 0 )
+				continue;
+			__m512i ids = _mm512_add_epi32( lanes, _mm512_set1_epi32((int)i) );
+			_mm512_mask_compressstoreu_epi32(out + selected, mask, ids);
+			selected += __builtin_popcount(mask);
+		}
+		return selected + selectZeroScalarFrom(counts, i, n, out + selected);
+	}
+
+	__attribute__((target("avx512f")))
+	static size_t countFlaggedAVX512(const uint8_t *flags, const uint32_t *ids, size_t n)
+	{
+		size_t flagged = 0, i = 0;
+		__m512i lowByte = _mm512_set1_epi32(0xFF);
+		for (; i + 16 <= n; i += 16)
+		{
+			__m512i index = _mm512_loadu_si512(ids + i);
+			__m512i bytes = _mm512_i32gather_epi32(index, flags, 1);
+			flagged += __builtin_popcount( _mm512_test_epi32_mask(bytes, lowByte) );
+		}
+		return flagged + countFlaggedScalar(flags, ids + i, n - i);
+	}
+
+	/// Tail of the vector selectZero versions, IDs start at begin
+	static size_t selectZeroScalarFrom(const int32_t *counts, size_t begin, size_t n, uint32_t *out)
+	{
+		size_t selected = 0;
+		for (size_t i = begin; i < n; ++i)
+		{
+			if ( counts[i] == 0 )
+				out[selected++] = i;
+		}
+		return selected;
+	}
+#endif
+};
+
+#endif /* FRONTIER_KERNELS_H */
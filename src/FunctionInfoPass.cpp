@@ -1,72 +1,353 @@
 
+#include <algorithm>
+#include <mutex>
+#include <set>
 #include "FunctionInfoPass.h"
 
 llvm::AnalysisKey FunctionInfoPass::Key;
 
+/// Functions may be analyzed concurrently (see ModuleScheduler), so
+/// their dumps and export messages are written one function at a time
+static std::mutex outputMutex;
+
+FunctionAnalysisInfo
+FunctionInfoPass::run(llvm::Function &function, llvm::FunctionAnalysisManager &FAM)
+{
+  if ( function.isDeclaration() )
+    return *getCallSummary(&function);
+
+  auto recursive = RecursiveResults.find(&function);
+  if ( recursive != RecursiveResults.end() )
+    return *recursive->second;
+
+  auto members = findRecursion(function, FAM);
+  if ( !members.empty() )
+  {
+    analyzeRecursion(members, FAM);
+    return *RecursiveResults[&function];
+  }
+
+  FunctionAnalysisInfo analysis(&function);
+  gatherAnalysis(function, analysis, FAM);
+  return analysis;
+}
+
+
+/// Adds the bytes a memory operation moves (DataLayout store sizes) or
+/// the arithmetic operations of inst, one per vector lane
+static void countTraffic(llvm::Instruction *inst, const llvm::DataLayout &DL, LoopAnalysisInfo &traffic)
+{
+  if ( auto load = llvm::dyn_cast<llvm::LoadInst>(inst) )
+    traffic.bytesRead += DL.getTypeStoreSize( load->getType() );
+  else if ( auto store = llvm::dyn_cast<llvm::StoreInst>(inst) )
+    traffic.bytesWritten += DL.getTypeStoreSize( store->getValueOperand()->getType() );
+  else if ( auto RMW = llvm::dyn_cast<llvm::AtomicRMWInst>(inst) )
+  {
+    traffic.bytesRead += DL.getTypeStoreSize( RMW->getValOperand()->getType() );
+    traffic.bytesWritten += DL.getTypeStoreSize( RMW->getValOperand()->getType() );
+  }
+  else if ( auto CAS = llvm::dyn_cast<llvm::AtomicCmpXchgInst>(inst) )
+  {
+    traffic.bytesRead += DL.getTypeStoreSize( CAS->getNewValOperand()->getType() );
+    traffic.bytesWritten += DL.getTypeStoreSize( CAS->getNewValOperand()->getType() );
+  }
+  else if ( auto memIntrinsic = llvm::dyn_cast<llvm::MemIntrinsic>(inst) )
+  {
+    //only constant lengths are known statically
+    auto length = llvm::dyn_cast<llvm::ConstantInt>( memIntrinsic->getLength() );
+    if ( length == nullptr )
+      return;
+    if ( llvm::isa<llvm::MemTransferInst>(inst) )
+      traffic.bytesRead += length->getZExtValue();
+    traffic.bytesWritten += length->getZExtValue();
+  }
+  else if ( inst->isBinaryOp() || llvm::isa<llvm::CmpInst>(inst) )
+    traffic.opCount += CostModel::getLaneCount( inst->getType() );
+}
+
+
+/// Runs of each block and edge per call of function: measured if it was
+/// profiled (and ran), else estimated from its branch probabilities if
+/// static weights are on; false if neither
+static bool getBlockFrequencies(llvm::Function &function, llvm::FunctionAnalysisManager &FAM,
+                                BlockFrequency_t &Blocks, EdgeFrequency_t &Edges, WeightedAnalysisInfo &weighted)
+{
+  auto profile = blockProfiles.find(&function);
+  if ( profile != blockProfiles.end() && profile->second.calls != 0 )
+  {
+    double calls = profile->second.calls;
+    for (auto &block : profile->second.Blocks)
+      Blocks[block.first] = block.second / calls;
+    for (auto &edge : profile->second.Edges)
+      Edges[edge.first] = edge.second / calls;
+    weighted.source = "profile";
+    weighted.calls = profile->second.calls;
+    return true;
+  }
+  if ( !staticWeights )
+    return false;
+
+  auto &BFI = FAM.getResult<llvm::BlockFrequencyAnalysis>(function);
+  auto &BPI = FAM.getResult<llvm::BranchProbabilityAnalysis>(function);
+  double entry = BFI.getEntryFreq();
+  for (auto &BB : function)
+  {
+    double frequency = BFI.getBlockFreq(&BB).getFrequency() / entry;
+    Blocks[&BB] = frequency;
+    for (auto successor : llvm::successors(&BB))
+    {
+      auto probability = BPI.getEdgeProbability(&BB, successor);
+      Edges[ std::make_pair((const llvm::BasicBlock*)&BB, (const llvm::BasicBlock*)successor) ] =
+        frequency * probability.getNumerator() / probability.getDenominator();
+    }
+  }
+  weighted.source = "static block frequency";
+  return true;
+}
+
+
 /// Helper function
 void 
 FunctionInfoPass::gatherAnalysis(llvm::Function &function, FunctionAnalysisInfo &analysis,
-                                 llvm::FunctionAnalysisManager &FAM)
+                                 llvm::FunctionAnalysisManager &FAM,
+                                 const FunctionAnalysis_t *estimates, bool emit)
 {
-  DAGBuilder *DAG_builder = new DAGBuilder();
-  DAG_builder->init();
+  auto &DT = FAM.getResult<llvm::DominatorTreeAnalysis>(function);
 
   ///
-  function.dump();
+  if (emit)
+  {
+    std::lock_guard<std::mutex> lock(outputMutex);
+    function.dump();
+  }
   // int storeInstCount = 0;
   ///
 
+  /// Counts and callee analyses. The FAM is not thread safe, so every
+  /// callee is analyzed before the blocks are built.
+  CalleeAnalysis_t CalleeAnalyses;
+  std::vector<llvm::BasicBlock*> blocks;
+  auto &DL = function.getParent()->getDataLayout();
+  std::unordered_map<const llvm::BasicBlock*, LoopAnalysisInfo> BlockTraffic;
+
+  /// With block frequencies every count is also weighted by the runs of
+  /// its block per call, the traffic of a callee by its own weights
+  BlockFrequency_t BlockFrequency;
+  EdgeFrequency_t EdgeFrequency;
+  bool weighted = getBlockFrequencies(function, FAM, BlockFrequency, EdgeFrequency, analysis.Weighted);
+  auto &W = analysis.Weighted;
   for (auto blockIter=function.begin(); blockIter!=function.end(); ++blockIter)
   {
     llvm::BasicBlock *BB = &*blockIter;
+    blocks.push_back(BB);
+    auto &traffic = BlockTraffic[BB];
+    double frequency = weighted ? BlockFrequency[BB] : 0;
+    double calleeOps = 0, calleeBytes = 0;	//weighted callees less their static traffic
     for (auto instIter=BB->begin(); instIter!=BB->end(); ++instIter) 
     {
       llvm::Instruction *inst = &*instIter;
       analysis.instCount++;
+      W.instCount += frequency;
       auto opCode = inst->getOpcode();
+      countTraffic(inst, DL, traffic);
 
-      if ( opCode == llvm::Instruction::Call )
+      if ( llvm::isa<llvm::DbgInfoIntrinsic>(inst) )
       {
-        llvm::Function *callee = llvm::cast<llvm::CallInst>(inst)->getCalledFunction();
-        auto &FA = FAM.getResult<FunctionInfoPass>(*callee);
-        analysis.InnerFA[callee] = &FA;
-
-        //if function is void just add floating node to DAG w/ set widths and depths
-        DAG_builder->addVoidFunction(inst, analysis.varWidth,
-                                           analysis.varDepth,
-                                           analysis.opWidth,
-                                           analysis.opDepth);
-
-        //else [need to find how to tie into other nodes]
         continue;
       }
-      else 
+      else if ( opCode == llvm::Instruction::Call )
       {
-        DAG_builder->add(inst);
+        llvm::Function *callee = llvm::cast<llvm::CallInst>(inst)->getCalledFunction();
+        FunctionAnalysisInfo *FA = nullptr;
+        if ( estimates != nullptr && estimates->count(callee) )
+        {
+          //recursive calls are not inner analyses, they would nest forever
+          FA = estimates->find(callee)->second;
+        }
+        else
+        {
+          FA = getCalleeAnalysis(callee, FAM);
+          if ( callee != nullptr )
+            analysis.InnerFA[callee] = FA;
+        }
+        if ( callee == nullptr || (callee->isDeclaration() && !callSummaries.lookup(callee->getName())) )
+          analysis.unknownCalls++;
+        CalleeAnalyses[inst] = FA;
+        traffic.opCount += FA->opCount;
+        traffic.bytesRead += FA->bytesRead;
+        traffic.bytesWritten += FA->bytesWritten;
+        if ( !FA->Weighted.source.empty() )
+        {
+          calleeOps += FA->Weighted.opCount - FA->opCount;
+          calleeBytes += FA->Weighted.bytes - (FA->bytesRead + FA->bytesWritten);
+        }
+        continue;
       }
 
       switch ( opCode ) {
         case (llvm::Instruction::Load):
           analysis.readCount++;
+          W.readCount += frequency;
           break;
         case (llvm::Instruction::Store):
           analysis.writeCount++;
+          W.writeCount += frequency;
           break;
         default:
           break;
       }
     }
     analysis.bbCount++;
+    analysis.opCount += traffic.opCount;
+    analysis.bytesRead += traffic.bytesRead;
+    analysis.bytesWritten += traffic.bytesWritten;
+    traffic.weightedOps = frequency * (traffic.opCount + calleeOps);
+    W.opCount += traffic.weightedOps;
+    W.bytes += frequency * (traffic.bytesRead + traffic.bytesWritten + calleeBytes);
   }
 
+  /// Traffic of each loop, from its blocks (inner loops included)
+  for (auto loop : FAM.getResult<llvm::LoopAnalysis>(function).getLoopsInPreorder())
+  {
+    LoopAnalysisInfo loopTraffic = LoopAnalysisInfo();
+    loopTraffic.header = loop->getHeader()->getName().str();
+    loopTraffic.depth = loop->getLoopDepth();
+    for (auto BB : loop->blocks())
+    {
+      auto &traffic = BlockTraffic[BB];
+      loopTraffic.opCount += traffic.opCount;
+      loopTraffic.bytesRead += traffic.bytesRead;
+      loopTraffic.bytesWritten += traffic.bytesWritten;
+      loopTraffic.weightedOps += traffic.weightedOps;
+    }
+
+    //the header runs once per trip, each entry comes in over an edge
+    //from outside the loop
+    double entries = 0;
+    for (auto predecessor : llvm::predecessors( loop->getHeader() ))
+    {
+      auto edge = EdgeFrequency.find( std::make_pair((const llvm::BasicBlock*)predecessor,
+                                                     (const llvm::BasicBlock*)loop->getHeader()) );
+      if ( !loop->contains(predecessor) && edge != EdgeFrequency.end() )
+        entries += edge->second;
+    }
+    if ( entries > 0 )
+      loopTraffic.trips = BlockFrequency[ loop->getHeader() ] / entries;
+    analysis.Loops.push_back(loopTraffic);
+  }
+
+  /// Split the blocks into contiguous partitions of about the same
+  /// instruction count and build a DAG fragment per partition in parallel.
+  /// Dominance queries are made read-only by numbering the tree first.
+  DT.updateDFSNumbers();
+  WorkerPool pool(threadCount != 0 ? threadCount : analysisThreads);
+  auto partitions = partitionBlocks(blocks, analysis.instCount, pool.size());
+  std::unordered_map<const llvm::BasicBlock*, unsigned> FragmentOf;
+  for (unsigned i = 0; i+1 < partitions.size(); ++i)
+  {
+    for (size_t b = partitions[i]; b < partitions[i+1]; ++b)
+      FragmentOf[ blocks[b] ] = i;
+  }
+
+  std::vector<DAGBuilder*> fragments(partitions.size()-1, nullptr);
+  pool.parallelFor(fragments.size(), [&](size_t i) {
+    fragments[i] = buildPartitionDAG(blocks, partitions[i], partitions[i+1], DT, CalleeAnalyses);
+  });
+
+  /// Stitch the fragments with data edges across partitions, then add the
+  /// memory and control dependences of the whole function
+  DAGBuilder *DAG_builder = new DAGBuilder(&costModel);
+  DAG_builder->init();
+  DAG_builder->setDominatorTree(&DT);
+  DAG_builder->stitch(fragments, FragmentOf, pool);
+  for (auto fragment : fragments)
+    delete fragment;
+
+  DAG_builder->addMemoryDependences(function, FAM.getResult<llvm::MemorySSAAnalysis>(function).getMSSA());
+  DAG_builder->addControlDependences(function, FAM.getResult<llvm::PostDominatorTreeAnalysis>(function));
   DAG_builder->lock();
+  if (hashConsing)
+  {
+    auto raw = DAG_builder->findSchedule(pool);
+    analysis.rawNodeCount = DAG_builder->getNodeCount();
+    analysis.rawArea = raw.area;
+    DAG_builder->hashCons();
+    DAG_builder->lock();
+  }
   // DAG_builder->fini();
   // DAG_builder->print();
+
+  auto schedule = DAG_builder->findSchedule(pool);
+  analysis.varWidth = schedule.width;
+  analysis.varDepth = schedule.height;
+  analysis.opWidth = schedule.opWidth;
+  analysis.opDepth = schedule.latency;
+  analysis.area = schedule.area;
+  analysis.vectorOps = schedule.vectorOps;
+  analysis.dataMoves = schedule.moves;
+  analysis.nodeCount = DAG_builder->getNodeCount();
+  if (weighted)
+    W.opDepth = DAG_builder->findWeightedLatency(BlockFrequency);
+  if (criticalPaths)
+    analysis.CriticalPath = DAG_builder->findCriticalPath();
+
+  if (isomorphicGroups)
+    analysis.Isomorphic = DAG_builder->findIsomorphicGroups();
+
+  auto datapath = DAG_builder->findDatapath();
+  analysis.valueBitWidth = datapath.valueBits;
+  analysis.opBitWidth = datapath.operatorBits;
+  for (auto &unit : datapath.Classes)
+  {
+    if ( unit.operators == 0 )
+      continue;
+    analysis.datapathBits += unit.bits;
+    analysis.declaredBits += unit.declaredBits;
+    analysis.Datapath.push_back(unit);
+  }
+
+  LiveProfile asapLive, listLive;
+  DAG_builder->findLiveValues(liveListWidth, asapLive, listLive);
+  analysis.liveValues = asapLive.peakValues;
+  analysis.liveBits = asapLive.peakBits;
+  analysis.listLiveValues = listLive.peakValues;
+  analysis.listLiveBits = listLive.peakBits;
+  analysis.listWidth = listLive.width;
+  analysis.asapSteps = asapLive.getStepCount();
+  analysis.listSteps = listLive.getStepCount();
   
+  if ( !emit )
+    return;
+
+  std::lock_guard<std::mutex> lock(outputMutex);
+  if ( !dagDirectory.empty() )
+  {
+    if ( !DAG_builder->writeDAGFile(function.getName(), dagDirectory, schedule) )
+      llvm::outs() << " ERROR: DAG file not generated!\n";
+  }
+
+  if (liveTimeline)
+  {
+    if ( !DAG_builder->writeLiveTimeline(function.getName(), dotDirectory, asapLive, listLive) )
+      llvm::outs() << " ERROR: Live timeline not generated!\n";
+  }
+
+  if (generateSVG)
+  {
+    if ( !DAG_builder->SVGGenerateFile(function.getName(), dotDirectory, pool) )
+      llvm::outs() << " ERROR: SVG file not generated!\n";
+  }
+
   if (generateDOT)
   {
-    if ( !DAG_builder->DOTGenerateFile(function.getName()) )
+    if ( !DAG_builder->DOTGenerateFile(function.getName(), dotDirectory, pool) )
       llvm::outs() << " ERROR: DOT file not generated!\n";
+    if ( dotSummary.enabled )
+    {
+      auto LI = dotSummary.cluster == LOOP_CLUSTER ? &FAM.getResult<llvm::LoopAnalysis>(function) : nullptr;
+      if ( !DAG_builder->DOTGenerateSummary(function, dotDirectory, dotSummary, LI) )
+        llvm::outs() << " ERROR: DOT summary not generated!\n";
+    }
   }
 
   // auto DG_builder = DAG_builder->getDGBuilder();
@@ -77,3 +358,228 @@ FunctionInfoPass::gatherAnalysis(llvm::Function &function, FunctionAnalysisInfo
 
 }
 
+
+/// Callees analyzed by the ModuleScheduler come from its summaries,
+/// functions without a body (and unknown callees) from the call summaries
+FunctionAnalysisInfo*
+FunctionInfoPass::getCalleeAnalysis(llvm::Function *callee, llvm::FunctionAnalysisManager &FAM)
+{
+  if ( callee == nullptr || callee->isDeclaration() )
+    return getCallSummary(callee);
+
+  if ( Summaries != nullptr )
+  {
+    auto summary = Summaries->find(callee);
+    if ( summary != Summaries->end() && summary->second != nullptr )
+      return summary->second;
+  }
+  return &FAM.getResult<FunctionInfoPass>(*callee);
+}
+
+
+FunctionAnalysisInfo*
+FunctionInfoPass::getCallSummary(llvm::Function *callee)
+{
+  auto &result = CallResults[callee];
+  if ( result )
+    return result.get();
+
+  auto cost = callee != nullptr ? callSummaries.lookup(callee->getName()) : nullptr;
+  if ( cost == nullptr )
+    cost = &callSummaries.getUnknownCost();
+
+  //a summarized call is a single operator of the given latency
+  result.reset( new FunctionAnalysisInfo(callee) );
+  if ( cost->latency != 0 || cost->area != 0 )
+  {
+    result->varWidth = 1;
+    result->varDepth = 1;
+    result->opWidth = 1;
+  }
+  result->opDepth = cost->latency;
+  result->area = cost->area;
+  return result.get();
+}
+
+
+/// The functions of the SCC of the call graph that holds function, function
+/// first, or nothing if function is not recursive. Only direct calls to
+/// functions whose result is not known yet are followed; the functions
+/// being analyzed further up the stack are callers of function and cannot
+/// be reached from it.
+std::vector<llvm::Function*>
+FunctionInfoPass::findRecursion(llvm::Function &function, llvm::FunctionAnalysisManager &FAM)
+{
+  auto getCallees = [&](llvm::Function *caller) {
+    std::vector<llvm::Function*> callees;
+    for (auto &BB : *caller)
+    {
+      for (auto &inst : BB)
+      {
+        auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+        auto callee = call != nullptr ? call->getCalledFunction() : nullptr;
+        if ( callee == nullptr || callee->isDeclaration() || RecursiveResults.count(callee) )
+          continue;
+        //the FAM holds a placeholder for the function being analyzed
+        if ( callee != &function && FAM.getCachedResult<FunctionInfoPass>(*callee) != nullptr )
+          continue;
+        if ( Summaries != nullptr && Summaries->count(callee) && Summaries->find(callee)->second != nullptr )
+          continue;
+        callees.push_back(callee);
+      }
+    }
+    return callees;
+  };
+
+  //everything function reaches, with the calls reversed
+  std::vector<llvm::Function*> reached(1, &function);
+  std::map< llvm::Function*, std::vector<llvm::Function*> > Callers;
+  std::set<llvm::Function*> seen(reached.begin(), reached.end());
+  for (size_t i = 0; i < reached.size(); ++i)
+  {
+    for (auto callee : getCallees(reached[i]))
+    {
+      Callers[callee].push_back(reached[i]);
+      if ( seen.insert(callee).second )
+        reached.push_back(callee);
+    }
+  }
+  if ( !Callers.count(&function) )
+    return std::vector<llvm::Function*>();
+
+  //the SCC is what also reaches function back
+  std::set<llvm::Function*> reachesBack;
+  std::vector<llvm::Function*> work(1, &function);
+  reachesBack.insert(&function);
+  while ( !work.empty() )
+  {
+    auto callee = work.back();
+    work.pop_back();
+    for (auto caller : Callers[callee])
+    {
+      if ( reachesBack.insert(caller).second )
+        work.push_back(caller);
+    }
+  }
+
+  std::vector<llvm::Function*> members;
+  for (auto member : reached)
+  {
+    if ( reachesBack.count(member) )
+      members.push_back(member);
+  }
+  return members;
+}
+
+
+/// Bounded fixpoint over a recursive SCC. Every recursive call starts out
+/// free; each round analyzes the members in turn with the latest estimates
+/// of the others, which unrolls the recursion one level deeper. The rounds
+/// stop once no estimate changes, or after recursionRounds rounds when the
+/// recursion has no fixed cost (e.g. its depth grows every round). Only
+/// the last round dumps and exports the DAGs.
+void
+FunctionInfoPass::analyzeRecursion(std::vector<llvm::Function*> &members,
+                                   llvm::FunctionAnalysisManager &FAM)
+{
+  FunctionAnalysis_t Estimates;
+  for (auto member : members)
+  {
+    RecursiveResults[member].reset( new FunctionAnalysisInfo(member) );
+    Estimates[member] = RecursiveResults[member].get();
+  }
+
+  //a converged estimate takes one more round to emit its DAGs
+  unsigned rounds = std::max(1u, recursionRounds);
+  unsigned round = 0, convergedRound = 0;
+  bool emitted = false;
+  while ( !emitted )
+  {
+    round++;
+    bool last = convergedRound != 0 || round >= rounds;
+    bool changed = false;
+    for (auto member : members)
+    {
+      std::unique_ptr<FunctionAnalysisInfo> next( new FunctionAnalysisInfo(member) );
+      gatherAnalysis(*member, *next, FAM, &Estimates, last);
+
+      auto &current = RecursiveResults[member];
+      if ( next->varWidth != current->varWidth || next->varDepth != current->varDepth ||
+           next->opWidth != current->opWidth || next->opDepth != current->opDepth ||
+           next->area != current->area )
+        changed = true;
+      current.swap(next);
+      Estimates[member] = current.get();
+    }
+    if ( !changed && convergedRound == 0 )
+      convergedRound = round;
+    emitted = last;
+  }
+
+  for (auto member : members)
+  {
+    RecursiveResults[member]->recursionRounds = convergedRound != 0 ? convergedRound : round;
+    RecursiveResults[member]->recursionConverged = convergedRound != 0;
+  }
+}
+
+
+std::vector<size_t>
+FunctionInfoPass::partitionBlocks(std::vector<llvm::BasicBlock*> &blocks, int instCount,
+                                  unsigned threadCount)
+{
+  /// A few partitions per thread even out uneven blocks; a single thread
+  /// builds the whole function as one fragment
+  size_t partitionCount = threadCount <= 1 ? 1 : std::min(blocks.size(), (size_t)threadCount * 4);
+  std::vector<size_t> partitions(1, 0);
+  size_t seen = 0;
+  for (size_t b = 0; b < blocks.size(); ++b)
+  {
+    seen += blocks[b]->size();
+    if ( partitions.size() < partitionCount &&
+         seen * partitionCount >= (size_t)instCount * partitions.size() )
+      partitions.push_back(b+1);
+  }
+  if ( partitions.back() != blocks.size() || partitions.size() == 1 )
+    partitions.push_back(blocks.size());
+  return partitions;
+}
+
+
+DAGBuilder*
+FunctionInfoPass::buildPartitionDAG(std::vector<llvm::BasicBlock*> &blocks, size_t begin, size_t end,
+                                    llvm::DominatorTree &DT, CalleeAnalysis_t &CalleeAnalyses)
+{
+  DAGBuilder *fragment = new DAGBuilder(&costModel);
+  fragment->init();
+  fragment->setDominatorTree(&DT);
+
+  for (size_t b = begin; b < end; ++b)
+  {
+    for (auto instIter=blocks[b]->begin(); instIter!=blocks[b]->end(); ++instIter)
+    {
+      llvm::Instruction *inst = &*instIter;
+      if ( llvm::isa<llvm::DbgInfoIntrinsic>(inst) )
+        continue;
+
+      auto calleeIter = CalleeAnalyses.find(inst);
+      if ( calleeIter != CalleeAnalyses.end() )
+      {
+        //the call node depends on its arguments and its value (if any)
+        //feeds its users
+        auto FA = calleeIter->second;
+        fragment->addFunctionCall(inst, FA->varWidth,
+                                        FA->varDepth,
+                                        FA->opWidth,
+                                        FA->opDepth,
+                                        FA->area);
+      }
+      else
+      {
+        fragment->add(inst);
+      }
+    }
+  }
+
+  return fragment;
+}
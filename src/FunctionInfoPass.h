@@ -1,15 +1,37 @@
 #ifndef FUNCTION_INFO_PASS_H
 #define FUNCTION_INFO_PASS_H
 
+#include <memory>
 #include <unordered_map>
 #include <llvm/IR/Function.h>
 #include <llvm/Support/raw_ostream.h>
 #include <LLVMHeaders.h>
 
 #include "AnalysisInfo.h"
+#include "BlockProfiler.h"
+#include "CallSummaries.h"
+#include "CostModel.h"
 #include "DAGBuilder.h"
+#include "WorkerPool.h"
 
 extern bool generateDOT;
+extern bool generateSVG;
+extern std::string dotDirectory;
+extern std::string dagDirectory;
+extern DOTSummaryOptions dotSummary;
+extern CostModel costModel;
+extern unsigned analysisThreads;
+extern bool hashConsing;
+extern CallSummaries callSummaries;
+extern unsigned recursionRounds;
+extern unsigned liveListWidth;
+extern bool liveTimeline;
+extern bool isomorphicGroups;
+extern BlockProfiles_t blockProfiles;
+extern bool staticWeights;
+extern bool criticalPaths;
+
+typedef std::map<llvm::Instruction*, FunctionAnalysisInfo*> CalleeAnalysis_t;
 
 /// New PassManager pass
 class FunctionInfoPass : public llvm::AnalysisInfoMixin<FunctionInfoPass>
@@ -20,16 +42,44 @@ class FunctionInfoPass : public llvm::AnalysisInfoMixin<FunctionInfoPass>
  public:
 	using Result = FunctionAnalysisInfo;
 
-  	FunctionAnalysisInfo run(llvm::Function &function, llvm::FunctionAnalysisManager &FAM)
-	{
-		FunctionAnalysisInfo analysis(&function);
-		gatherAnalysis(function, analysis, FAM);
-		return analysis;
-	}
+	/// Callees found in summaries are not analyzed again (see
+	/// ModuleScheduler); threadCount 0 means analysisThreads
+	FunctionInfoPass(const FunctionAnalysis_t *summaries=nullptr, unsigned threadCount=0) :
+		Summaries(summaries), threadCount(threadCount) {}
+
+	/// Functions without a body get their call summary; the functions of
+	/// a recursive SCC are analyzed together (see analyzeRecursion)
+  	FunctionAnalysisInfo run(llvm::Function &function, llvm::FunctionAnalysisManager &FAM);
 
-	/// Helper function
+	/// Helper function; callees found in estimates are recursive calls
+	/// costed by the current fixpoint estimate, emit is false for the
+	/// rounds whose DAG is not dumped or exported
   	void gatherAnalysis(llvm::Function &function, FunctionAnalysisInfo &analysis,
-                      llvm::FunctionAnalysisManager &FAM);
+                      llvm::FunctionAnalysisManager &FAM,
+                      const FunctionAnalysis_t *estimates=nullptr, bool emit=true);
+
+  	std::vector<size_t> partitionBlocks(std::vector<llvm::BasicBlock*> &blocks, int instCount,
+                                        unsigned threadCount);
+
+  	DAGBuilder* buildPartitionDAG(std::vector<llvm::BasicBlock*> &blocks, size_t begin, size_t end,
+                                  llvm::DominatorTree &DT, CalleeAnalysis_t &CalleeAnalyses);
+
+ private:
+	FunctionAnalysisInfo* getCalleeAnalysis(llvm::Function *callee, llvm::FunctionAnalysisManager &FAM);
+	FunctionAnalysisInfo* getCallSummary(llvm::Function *callee);
+
+	std::vector<llvm::Function*> findRecursion(llvm::Function &function, llvm::FunctionAnalysisManager &FAM);
+	void analyzeRecursion(std::vector<llvm::Function*> &members, llvm::FunctionAnalysisManager &FAM);
+
+ private:
+	const FunctionAnalysis_t *Summaries;
+	unsigned threadCount;
+
+	/// Summaries of declarations (nullptr: unknown callee) and results of
+	/// recursive functions, owned by the pass so that the FAM's results
+	/// may point to them
+	std::map< llvm::Function*, std::unique_ptr<FunctionAnalysisInfo> > CallResults;
+	std::map< llvm::Function*, std::unique_ptr<FunctionAnalysisInfo> > RecursiveResults;
 
 };
 
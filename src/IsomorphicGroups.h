@@ -0,0 +1,378 @@
+#ifndef ISOMORPHIC_GROUPS_H
+#define ISOMORPHIC_GROUPS_H
+
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include <vector>
+
+#include "AnalysisInfo.h"
+#include "DAGNode.h"
+#include "VisitMarks.h"
+
+/**
+ * @brief IsomorphicGroups
+ * Expression trees of a locked, scheduled DAG that could run side by side
+ * on the lanes of one SIMD or replicated datapath. The shape of an
+ * operator hashes its opcode, type and the shapes of its data operands in
+ * order; values not computed in the DAG (arguments, constants, phis,
+ * allocas, calls with side effects) are leaves whose shape is their type.
+ * Shapes come from one pass over the level order, and operators of equal
+ * shape form a group, so trees are never compared pairwise and the pass
+ * is linear in the nodes and edges.
+ *
+ * Groups are taken greedily, the most work (trees times operators per
+ * tree) first, ties in IR order. A tree inside a tree already taken is
+ * dropped, and so is a tree that depends on another tree of its group
+ * through any edge (memory and control included), found by one walk over
+ * the dependents of the group up to its highest level. The trees of a
+ * group are then bundled node by node, and the bundled DAG is leveled in
+ * operators to give the width and depth it would have vectorized.
+ */
+class IsomorphicGroups
+{
+private:
+	std::vector<DAGNode*> &Nodes;
+	const std::vector<unsigned> &Order;
+	const std::vector<int> &Level;
+	const std::vector<unsigned> &OperandStart;	//by node ID, into Operands
+	const std::vector<unsigned> &Operands;		//data operands in order
+	std::vector<uint8_t> IsTree;	//operators that may root or be inside a tree
+	std::vector<uint64_t> Shape;
+	std::vector<uint32_t> Size;		//operators of the tree, saturated
+	std::vector<uint32_t> Depth;	//operators on its longest path
+	std::vector<uint32_t> Position;	//IR order, UINT32_MAX if none
+
+public:
+	/// order holds every node ID, dependences first (the level order)
+	IsomorphicGroups(std::vector<DAGNode*> &nodes, const std::vector<unsigned> &order, const std::vector<int> &level,
+					 const std::vector<unsigned> &operandStart, const std::vector<unsigned> &operands) :
+		Nodes(nodes), Order(order), Level(level), OperandStart(operandStart), Operands(operands),
+		IsTree(nodes.size(), 0), Shape(nodes.size(), 0), Size(nodes.size(), 0), Depth(nodes.size(), 0),
+		Position(nodes.size(), UINT32_MAX)
+	{
+		std::unordered_map<const llvm::Value*, uint32_t> PositionOf;
+		for (auto node : Nodes)
+		{
+			auto inst = llvm::dyn_cast_or_null<llvm::Instruction>( node->getllvmValue() );
+			if ( inst == nullptr || !PositionOf.empty() )
+				continue;
+			for (auto &BB : *inst->getFunction())
+			{
+				for (auto &I : BB)
+					PositionOf.insert( std::make_pair(&I, (uint32_t)PositionOf.size()) );
+			}
+		}
+		for (auto node : Nodes)
+		{
+			auto position = PositionOf.find( node->getllvmValue() );
+			if ( position != PositionOf.end() )
+				Position[ node->getID() ] = position->second;
+			IsTree[ node->getID() ] = isTreeOperator(node);
+		}
+	}
+
+	IsomorphicAnalysisInfo run()
+	{
+		IsomorphicAnalysisInfo info;
+		findShapes();
+
+		// groups by shape, members in IR order
+		std::vector<unsigned> ByPosition;
+		for (auto node : Nodes)
+		{
+			if ( IsTree[node->getID()] )
+				ByPosition.push_back( node->getID() );
+		}
+		std::sort(ByPosition.begin(), ByPosition.end(),
+				  [this](unsigned a, unsigned b) { return Position[a] < Position[b]; });
+		std::unordered_map< uint64_t, std::vector<unsigned> > ByShape;
+		for (auto id : ByPosition)
+			ByShape[ Shape[id] ].push_back(id);
+
+		std::vector< std::vector<unsigned>* > Candidates;
+		for (auto &shape_pair : ByShape)
+		{
+			if ( shape_pair.second.size() > 1 )
+				Candidates.push_back(&shape_pair.second);
+		}
+		std::sort(Candidates.begin(), Candidates.end(),
+				  [this](const std::vector<unsigned> *a, const std::vector<unsigned> *b) {
+					  uint64_t workA = (uint64_t)a->size() * Size[a->front()];
+					  uint64_t workB = (uint64_t)b->size() * Size[b->front()];
+					  if ( workA != workB )
+						  return workA > workB;
+					  return Position[a->front()] < Position[b->front()];
+				  });
+
+		std::vector<uint8_t> Covered(Nodes.size(), 0);
+		std::vector<unsigned> Bundle(Nodes.size());
+		for (size_t id = 0; id < Bundle.size(); ++id)
+			Bundle[id] = id;
+		VisitMarks marks(Nodes.size()), memberMarks(Nodes.size());
+		std::vector<unsigned> members, stack;
+		for (auto candidate : Candidates)
+		{
+			members.clear();
+			for (auto id : *candidate)
+			{
+				if ( !Covered[id] )
+					members.push_back(id);
+			}
+			if ( members.size() < 2 || !dropDependent(members, marks, memberMarks) )
+				continue;
+
+			auto first = members.front();
+			IsomorphicGroupInfo group;
+			group.root = llvm::cast<llvm::Instruction>( Nodes[first]->getllvmValue() )->getOpcodeName();
+			group.lanes = members.size();
+			group.operators = Size[first];
+			group.depth = Depth[first];
+			info.Groups.push_back(group);
+			info.lanes += group.lanes;
+			for (auto member : members)
+				info.packedOperators += cover(member, Covered, stack);
+			for (size_t m = 1; m < members.size(); ++m)
+				bundle(first, members[m], Bundle, marks);
+		}
+
+		std::vector<unsigned> Identity( Nodes.size() );
+		for (size_t id = 0; id < Identity.size(); ++id)
+			Identity[id] = id;
+		for (auto node : Nodes)
+			info.operators += node->getType() != VAL;
+		levelBundles(Identity, info.scalarWidth, info.scalarDepth);
+		levelBundles(Bundle, info.vectorWidth, info.vectorDepth);
+		return info;
+	}
+
+private:
+	static bool isTreeOperator(DAGNode *node)
+	{
+		if ( node->getType() != INST && node->getType() != FUNC )
+			return false;
+		auto inst = llvm::cast<llvm::Instruction>( node->getllvmValue() );
+		if ( llvm::isa<llvm::PHINode>(inst) || llvm::isa<llvm::AllocaInst>(inst) ||
+			 inst->isTerminator() || inst->isEHPad() )
+			return false;
+		return !llvm::isa<llvm::CallInst>(inst) || !inst->mayHaveSideEffects();
+	}
+
+	void findShapes()
+	{
+		for (auto id : Order)
+		{
+			auto value = Nodes[id]->getllvmValue();
+			if ( !IsTree[id] )
+			{
+				Shape[id] = llvm::hash_combine( UINT_MAX, value != nullptr ? value->getType() : nullptr );
+				continue;
+			}
+
+			auto inst = llvm::cast<llvm::Instruction>(value);
+			uint64_t size = 1;
+			uint32_t depth = 0;
+			std::vector<uint64_t> operandShapes;
+			for (auto i = OperandStart[id]; i < OperandStart[id + 1]; ++i)
+			{
+				operandShapes.push_back( Shape[Operands[i]] );
+				size += Size[ Operands[i] ];
+				depth = std::max(depth, Depth[ Operands[i] ]);
+			}
+			unsigned predicate = 0;
+			if ( auto cmp = llvm::dyn_cast<llvm::CmpInst>(inst) )
+				predicate = cmp->getPredicate();
+			const llvm::Function *callee = nullptr;
+			if ( auto call = llvm::dyn_cast<llvm::CallInst>(inst) )
+				callee = call->getCalledFunction();
+			Shape[id] = llvm::hash_combine( inst->getOpcode(), inst->getType(), predicate, callee,
+				llvm::hash_combine_range(operandShapes.begin(), operandShapes.end()) );
+			Size[id] = std::min<uint64_t>(size, UINT32_MAX);
+			Depth[id] = depth + 1;
+		}
+	}
+
+	/// Drops the members that depend on another member, false if fewer
+	/// than two remain
+	bool dropDependent(std::vector<unsigned> &members, VisitMarks &marks, VisitMarks &memberMarks)
+	{
+		marks.reset();
+		memberMarks.reset();
+		int top = 0;
+		std::vector<unsigned> stack;
+		for (auto member : members)
+		{
+			memberMarks.visit(member);
+			marks.visit(member);
+			stack.push_back(member);
+			top = std::max(top, Level[member]);
+		}
+
+		std::vector<unsigned> dropped;
+		while ( !stack.empty() )
+		{
+			auto id = stack.back();
+			stack.pop_back();
+			for (auto predecessor_pair : Nodes[id]->getPredecessors())
+			{
+				auto next = predecessor_pair.second->getID();
+				if ( Level[next] > top )
+					continue;
+				if ( memberMarks.isVisited(next) )
+					dropped.push_back(next);
+				if ( marks.visit(next) )
+					stack.push_back(next);
+			}
+		}
+		if ( dropped.empty() )
+			return true;
+
+		memberMarks.reset();
+		for (auto id : dropped)
+			memberMarks.visit(id);
+		members.erase( std::remove_if(members.begin(), members.end(),
+									  [&memberMarks](unsigned id) { return memberMarks.isVisited(id); }),
+					   members.end() );
+		return members.size() > 1;
+	}
+
+	/// Marks the tree of root, down to the trees covered already, and
+	/// returns the operators it marked (shared ones count once)
+	size_t cover(unsigned root, std::vector<uint8_t> &Covered, std::vector<unsigned> &stack)
+	{
+		size_t covered = 1;
+		Covered[root] = 1;
+		stack.assign(1, root);
+		while ( !stack.empty() )
+		{
+			auto id = stack.back();
+			stack.pop_back();
+			for (auto i = OperandStart[id]; i < OperandStart[id + 1]; ++i)
+			{
+				auto operand = Operands[i];
+				if ( IsTree[operand] && !Covered[operand] )
+				{
+					Covered[operand] = 1;
+					stack.push_back(operand);
+					covered++;
+				}
+			}
+		}
+		return covered;
+	}
+
+	/// Walks two trees of equal shape in step and moves each node of the
+	/// second into the bundle of its counterpart in the first
+	void bundle(unsigned first, unsigned second, std::vector<unsigned> &Bundle, VisitMarks &marks)
+	{
+		marks.reset();
+		std::vector< std::pair<unsigned, unsigned> > stack(1, std::make_pair(first, second));
+		while ( !stack.empty() )
+		{
+			auto pair = stack.back();
+			stack.pop_back();
+			if ( pair.first == pair.second || Bundle[pair.second] != pair.second || !marks.visit(pair.second) )
+				continue;
+			Bundle[pair.second] = Bundle[pair.first];
+
+			auto i = OperandStart[pair.first], j = OperandStart[pair.second];
+			for ( ; i < OperandStart[pair.first + 1] && j < OperandStart[pair.second + 1]; ++i, ++j)
+			{
+				if ( IsTree[Operands[i]] && IsTree[Operands[j]] )
+					stack.push_back( std::make_pair(Operands[i], Operands[j]) );
+			}
+		}
+	}
+
+	/// Width (most operator bundles on one level) and depth (operators on
+	/// the longest path) of the DAG with each bundle as one node. Bundles
+	/// are leveled once all of their dependences are; a bundle left on a
+	/// cycle (trees that were independent only at their roots) is leveled
+	/// from the dependences leveled so far.
+	void levelBundles(const std::vector<unsigned> &Bundle, unsigned &width, unsigned &depth)
+	{
+		size_t nodeCount = Nodes.size();
+		std::vector<unsigned> MemberStart(nodeCount + 1, 0), Members(nodeCount);
+		for (size_t id = 0; id < nodeCount; ++id)
+			MemberStart[ Bundle[id] + 1 ]++;
+		for (size_t b = 1; b <= nodeCount; ++b)
+			MemberStart[b] += MemberStart[b - 1];
+		std::vector<unsigned> fill(MemberStart.begin(), MemberStart.end() - 1);
+		for (size_t id = 0; id < nodeCount; ++id)
+			Members[ fill[Bundle[id]]++ ] = id;
+
+		std::vector<int> pending(nodeCount, 0), opLevel(nodeCount, 0);
+		std::vector<uint8_t> done(nodeCount, 0);
+		for (auto node : Nodes)
+		{
+			for (auto successor_pair : node->getSuccessors())
+			{
+				if ( Bundle[successor_pair.second->getID()] != Bundle[node->getID()] )
+					pending[ Bundle[node->getID()] ]++;
+			}
+		}
+
+		std::vector<unsigned> ready;
+		auto finish = [&](unsigned b) {
+			done[b] = 1;
+			int level = 0;
+			for (auto m = MemberStart[b]; m < MemberStart[b + 1]; ++m)
+			{
+				for (auto successor_pair : Nodes[Members[m]]->getSuccessors())
+				{
+					auto dependence = Bundle[ successor_pair.second->getID() ];
+					if ( dependence != b )
+						level = std::max(level, opLevel[dependence]);
+				}
+			}
+			opLevel[b] = level + (Nodes[b]->getType() != VAL);
+			for (auto m = MemberStart[b]; m < MemberStart[b + 1]; ++m)
+			{
+				for (auto predecessor_pair : Nodes[Members[m]]->getPredecessors())
+				{
+					auto dependent = Bundle[ predecessor_pair.second->getID() ];
+					if ( dependent != b && --pending[dependent] == 0 )
+						ready.push_back(dependent);
+				}
+			}
+		};
+		auto drain = [&]() {
+			while ( !ready.empty() )
+			{
+				auto b = ready.back();
+				ready.pop_back();
+				if ( !done[b] )
+					finish(b);
+			}
+		};
+		for (auto id : Order)
+		{
+			if ( Bundle[id] == id && pending[id] == 0 )
+				ready.push_back(id);
+		}
+		drain();
+		for (auto id : Order)
+		{
+			if ( Bundle[id] == id && !done[id] )
+			{
+				finish(id);
+				drain();
+			}
+		}
+
+		std::vector<unsigned> perLevel(1, 0);
+		depth = 0;
+		for (size_t b = 0; b < nodeCount; ++b)
+		{
+			if ( Bundle[b] != b || Nodes[b]->getType() == VAL )
+				continue;
+			if ( (size_t)opLevel[b] >= perLevel.size() )
+				perLevel.resize(opLevel[b] + 1, 0);
+			perLevel[ opLevel[b] ]++;
+			depth = std::max(depth, (unsigned)opLevel[b]);
+		}
+		width = *std::max_element( perLevel.begin(), perLevel.end() );
+	}
+};
+
+#endif /* ISOMORPHIC_GROUPS_H */
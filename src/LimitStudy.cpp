@@ -0,0 +1,362 @@
+
+#include <algorithm>
+#include "LimitStudy.h"
+#include "llvmEstimator.h"
+
+static const size_t eventCapacity = 1 << 16;
+
+
+LimitStudy::LimitStudy(llvm::Module &module, const CostModel &costs, const CallSummaries &calls,
+                       std::vector<unsigned> windows) :
+  module(module), costs(costs), calls(calls), Windows(1, 0), eventCount(0), depth(0),
+  instructions(0), work(0)
+{
+  for (auto window : windows)
+  {
+    if ( window != 0 )
+      Windows.push_back(window);
+  }
+}
+
+
+bool LimitStudy::run(llvm::Function &entry, const std::string &arguments, LimitAnalysisInfo &limits)
+{
+  llvm::ValueToValueMapTy VMap;
+  std::unique_ptr<llvm::Module> clone = llvm::CloneModule(module, VMap);
+  instrument(*clone);
+  std::vector< std::vector<char> > Buffers;
+  auto wrapper = buildCallWrapper(*clone, *llvm::cast<llvm::Function>( VMap[&entry] ), arguments, Buffers);
+  if ( wrapper == nullptr )
+    return false;
+
+  size_t K = Windows.size();
+  Events.resize(eventCapacity);
+  eventCount = 0;
+  depth = 0;
+  Memory.clear();
+  MemoryTimes.clear();
+  Retired.resize(K);
+  for (size_t k = 0; k < K; ++k)
+    Retired[k].assign(Windows[k], 0);
+  LastRetire.assign(K, 0);
+  Span.assign(K, 0);
+  instructions = 0;
+  work = 0;
+
+  auto traceFunction = clone->getFunction("__estimator_trace");
+  std::unique_ptr<llvm::ExecutionEngine> engine( buildExecutionEngine(clone) );
+  if ( !engine )
+    return false;
+  engine->addGlobalMapping(traceFunction, reinterpret_cast<void*>(&LimitStudy::trace));
+  engine->runFunction(wrapper, std::vector<llvm::GenericValue>());
+  drain();
+
+  limits.entry = entry.getName().str();
+  limits.instructions = instructions;
+  limits.work = work;
+  limits.Spans.clear();
+  for (size_t k = 0; k < K; ++k)
+    limits.Spans.push_back( std::make_pair(Windows[k], Span[k]) );
+  return true;
+}
+
+
+void LimitStudy::trace(LimitStudy *study, uint32_t id, uint64_t address)
+{
+  Event event = {id, address};
+  study->Events[study->eventCount++] = event;
+  if ( study->eventCount == study->Events.size() )
+    study->drain();
+}
+
+
+/// Helper functions
+void LimitStudy::instrument(llvm::Module &clone)
+{
+  auto &context = clone.getContext();
+  auto &DL = clone.getDataLayout();
+  llvm::Type *traceArgs[] = {llvm::Type::getInt8PtrTy(context), llvm::Type::getInt32Ty(context),
+                             llvm::Type::getInt64Ty(context)};
+  auto traceFunction = llvm::Function::Create(
+    llvm::FunctionType::get(llvm::Type::getVoidTy(context), traceArgs, false),
+    llvm::GlobalValue::ExternalLinkage, "__estimator_trace", &clone);
+  auto study = llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::get(traceArgs[2], (uintptr_t)this), traceArgs[0]);
+
+  std::unordered_map<const llvm::Function*, uint32_t> FunctionIndex;
+  uint32_t functionCount = 0;
+  for (auto &function : clone)
+  {
+    if ( !function.isDeclaration() && &function != traceFunction )
+      FunctionIndex[&function] = functionCount++;
+  }
+  Operations.clear();
+  Operands.clear();
+  Slots.assign(functionCount, 0);
+  Args.assign(functionCount, 0);
+  PhiSlots.assign(functionCount, std::vector< std::pair<uint32_t, uint32_t> >());
+
+  llvm::IRBuilder<> builder(context);
+  for (auto &function : clone)
+  {
+    auto index = FunctionIndex.find(&function);
+    if ( index == FunctionIndex.end() )
+      continue;
+    uint32_t f = index->second;
+
+    //every value of the function has a slot in its frames, the arguments last
+    std::unordered_map<const llvm::Value*, uint32_t> SlotOf;
+    std::unordered_map<const llvm::BasicBlock*, uint32_t> BlockOf;
+    std::vector<llvm::Instruction*> Traced;
+    std::unordered_map<const llvm::BasicBlock*, llvm::Instruction*> FirstInsertion;
+    uint32_t slotCount = 0, blockCount = 0;
+    for (auto &BB : function)
+    {
+      uint32_t phiStart = slotCount;
+      BlockOf[&BB] = blockCount++;
+      if ( BB.getFirstInsertionPt() != BB.end() )
+        FirstInsertion[&BB] = &*BB.getFirstInsertionPt();
+      for (auto &inst : BB)
+      {
+        SlotOf[&inst] = slotCount++;
+        if ( !llvm::isa<llvm::DbgInfoIntrinsic>(inst) && FirstInsertion.count(&BB) )
+          Traced.push_back(&inst);
+      }
+      PhiSlots[f].push_back( std::make_pair(phiStart, phiStart + (uint32_t)std::distance(BB.begin(), BB.getFirstNonPHI()->getIterator())) );
+    }
+    for (auto &argument : function.args())
+      SlotOf[&argument] = slotCount++;
+    Slots[f] = slotCount;
+    Args[f] = function.arg_size();
+
+    auto getSlot = [&SlotOf](const llvm::Value *value) {
+      auto slot = SlotOf.find(value);
+      return slot != SlotOf.end() ? slot->second : NONE;
+    };
+    for (auto inst : Traced)
+    {
+      Operation operation;
+      operation.function = f;
+      operation.block = BlockOf[ inst->getParent() ];
+      operation.slot = SlotOf[inst];
+      operation.latency = std::max(0, costs.lookup(inst).latency);
+      operation.bytes = 0;
+      operation.operandStart = Operands.size();
+      operation.kind = PLAIN;
+      operation.enters = inst == Traced.front();
+      operation.callsBody = false;
+
+      llvm::Value *address = nullptr;
+      if ( auto phi = llvm::dyn_cast<llvm::PHINode>(inst) )
+      {
+        operation.kind = PHI;
+        operation.latency = 0;
+        for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+        {
+          Operands.push_back( BlockOf[ phi->getIncomingBlock(i) ] );
+          Operands.push_back( getSlot( phi->getIncomingValue(i) ) );
+        }
+      }
+      else
+      {
+        for (auto &operand : inst->operands())
+          Operands.push_back( getSlot(operand) );
+      }
+
+      if ( auto load = llvm::dyn_cast<llvm::LoadInst>(inst) )
+      {
+        operation.kind = LOAD;
+        operation.bytes = DL.getTypeStoreSize( load->getType() );
+        address = load->getPointerOperand();
+      }
+      else if ( auto store = llvm::dyn_cast<llvm::StoreInst>(inst) )
+      {
+        operation.kind = STORE;
+        operation.bytes = DL.getTypeStoreSize( store->getValueOperand()->getType() );
+        address = store->getPointerOperand();
+      }
+      else if ( auto call = llvm::dyn_cast<llvm::CallInst>(inst) )
+      {
+        //a body costs what it runs, anything else its call summary
+        auto callee = call->getCalledFunction();
+        const CallCost *cost = nullptr;
+        if ( callee == nullptr && !call->isInlineAsm() )
+          operation.callsBody = true;
+        else if ( callee != nullptr && !callee->isDeclaration() )
+          operation.callsBody = true;
+        else if ( callee != nullptr )
+          cost = calls.lookup( callee->getName() );
+        operation.kind = CALL;
+        operation.latency = callee != nullptr && !callee->isDeclaration() ? 0 :
+                            (cost != nullptr ? cost->latency : calls.getUnknownCost().latency);
+      }
+      else if ( llvm::isa<llvm::ReturnInst>(inst) )
+        operation.kind = RETURN;
+      else if ( inst->isTerminator() )
+        operation.kind = TERMINATOR;
+      operation.operandEnd = Operands.size();
+
+      //phis and EH pads come first in their block, their events right after
+      auto before = inst;
+      if ( llvm::isa<llvm::PHINode>(inst) || inst->isEHPad() )
+        before = FirstInsertion[ inst->getParent() ];
+      builder.SetInsertPoint(before);
+      llvm::Value *traceValues[] = {study, builder.getInt32( Operations.size() ),
+                                    address != nullptr ? builder.CreatePtrToInt(address, builder.getInt64Ty()) :
+                                                         builder.getInt64(0)};
+      builder.CreateCall(traceFunction, traceValues);
+      Operations.push_back(operation);
+    }
+  }
+}
+
+
+void LimitStudy::drain()
+{
+  for (size_t i = 0; i < eventCount; ++i)
+    process(Events[i]);
+  eventCount = 0;
+}
+
+
+/// A new call of the function of operation, its arguments from the call
+/// into it (if the caller is instrumented)
+LimitStudy::Frame& LimitStudy::enter(const Operation &operation)
+{
+  size_t K = Windows.size();
+  if ( depth == Frames.size() )
+    Frames.push_back(Frame());
+  Frame *caller = depth > 0 ? &Frames[depth-1] : nullptr;
+  Frame &frame = Frames[depth++];
+  frame.function = operation.function;
+  frame.block = NONE;
+  frame.lastBlock = NONE;
+  frame.pendingCall = NONE;
+  if ( frame.Times.size() < Slots[operation.function] * K )
+    frame.Times.resize(Slots[operation.function] * K);
+
+  //values are always written before they are read, only the arguments
+  //need a time
+  uint32_t argStart = Slots[operation.function] - Args[operation.function];
+  for (size_t a = 0; a < Args[operation.function]; ++a)
+  {
+    bool passed = caller != nullptr && caller->pendingCall != NONE && (a+1) * K <= CallArgs.size();
+    for (size_t k = 0; k < K; ++k)
+      frame.Times[(argStart + a) * K + k] = passed ? CallArgs[a * K + k] : 0;
+  }
+  return frame;
+}
+
+
+uint64_t* LimitStudy::getWordTimes(uint64_t word, bool create)
+{
+  auto found = Memory.find(word);
+  if ( found != Memory.end() )
+    return &MemoryTimes[found->second];
+  if ( !create )
+    return nullptr;
+  Memory[word] = MemoryTimes.size();
+  MemoryTimes.resize(MemoryTimes.size() + Windows.size(), 0);
+  return &MemoryTimes[ MemoryTimes.size() - Windows.size() ];
+}
+
+
+void LimitStudy::process(const Event &event)
+{
+  const Operation &operation = Operations[event.id];
+  if ( operation.enters )
+    enter(operation);
+  if ( depth == 0 || Frames[depth-1].function != operation.function )
+    return;	//a frame left by unwinding
+
+  size_t K = Windows.size();
+  Frame &frame = Frames[depth-1];
+  auto &phis = PhiSlots[operation.function][operation.block];
+  if ( frame.block != operation.block )
+  {
+    frame.block = operation.block;
+    frame.PhiTimes.assign(frame.Times.begin() + phis.first * K, frame.Times.begin() + phis.second * K);
+  }
+  frame.pendingCall = NONE;
+
+  // start: the operands are computed and the loaded words stored
+  Scratch.assign(K, 0);
+  if ( operation.kind == PHI )
+  {
+    for (auto i = operation.operandStart; i < operation.operandEnd; i += 2)
+    {
+      if ( Operands[i] != frame.lastBlock || Operands[i+1] == NONE )
+        continue;
+      uint32_t slot = Operands[i+1];
+      //a phi of the same block is read as it was on entry
+      bool swapped = slot >= phis.first && slot < phis.second;
+      for (size_t k = 0; k < K; ++k)
+        Scratch[k] = swapped ? frame.PhiTimes[(slot - phis.first) * K + k] : frame.Times[slot * K + k];
+      break;
+    }
+    for (size_t k = 0; k < K; ++k)
+      frame.Times[operation.slot * K + k] = Scratch[k];
+    return;
+  }
+  for (auto i = operation.operandStart; i < operation.operandEnd; ++i)
+  {
+    if ( Operands[i] == NONE )
+      continue;
+    for (size_t k = 0; k < K; ++k)
+      Scratch[k] = std::max(Scratch[k], frame.Times[Operands[i] * K + k]);
+  }
+  uint64_t firstWord = event.address >> 3, lastWord = (event.address + std::max(1u, operation.bytes) - 1) >> 3;
+  if ( operation.kind == LOAD )
+  {
+    for (auto word = firstWord; word <= lastWord; ++word)
+    {
+      auto times = getWordTimes(word, false);
+      for (size_t k = 0; times != nullptr && k < K; ++k)
+        Scratch[k] = std::max(Scratch[k], times[k]);
+    }
+  }
+
+  // each window waits for the instruction a window back to retire
+  instructions++;
+  work += operation.latency;
+  for (size_t k = 0; k < K; ++k)
+  {
+    uint64_t *retired = Windows[k] != 0 ? &Retired[k][ (instructions - 1) % Windows[k] ] : nullptr;
+    uint64_t finish = (retired != nullptr ? std::max(Scratch[k], *retired) : Scratch[k]) + operation.latency;
+    frame.Times[operation.slot * K + k] = finish;
+    LastRetire[k] = std::max(LastRetire[k], finish);
+    if ( retired != nullptr )
+      *retired = LastRetire[k];
+    Span[k] = std::max(Span[k], finish);
+    Scratch[k] = finish;
+  }
+
+  if ( operation.kind == STORE )
+  {
+    for (auto word = firstWord; word <= lastWord; ++word)
+      std::copy(Scratch.begin(), Scratch.end(), getWordTimes(word, true));
+  }
+  else if ( operation.kind == CALL && operation.callsBody )
+  {
+    frame.pendingCall = operation.slot;
+    CallArgs.clear();
+    for (auto i = operation.operandStart; i < operation.operandEnd; ++i)
+    {
+      for (size_t k = 0; k < K; ++k)
+        CallArgs.push_back( Operands[i] != NONE ? frame.Times[Operands[i] * K + k] : 0 );
+    }
+  }
+  else if ( operation.kind == RETURN )
+  {
+    //the call's value is ready when the callee returns it
+    depth--;
+    Frame *caller = depth > 0 ? &Frames[depth-1] : nullptr;
+    if ( caller != nullptr && caller->pendingCall != NONE )
+      std::copy(Scratch.begin(), Scratch.end(), caller->Times.begin() + caller->pendingCall * K);
+  }
+
+  if ( operation.kind == RETURN || operation.kind == TERMINATOR )
+  {
+    frame.lastBlock = frame.block;
+    frame.block = NONE;
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef LIMIT_STUDY_H
+#define LIMIT_STUDY_H
+
+#include <unordered_map>
+#include <vector>
+#include <LLVMHeaders.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include "AnalysisInfo.h"
+#include "CallSummaries.h"
+#include "CostModel.h"
+
+/**
+ * @brief LimitStudy
+ * Dataflow limit of one run of a function: every instruction starts as
+ * soon as the values it uses are computed and the last store to the bytes
+ * it loads is done, with perfect branch prediction and renaming and
+ * unbounded operators. The span of the run under these rules is its
+ * dynamic critical path; against the summed latency of its instructions
+ * it bounds the speedup any datapath could reach on that input.
+ *
+ * Every function with a body is instrumented in a clone of the module
+ * (the analyzed IR does not change) to pass each instruction it runs, and
+ * the address of each load and store, to trace() before the instruction
+ * runs. The events go through a ring buffer of fixed size that is drained
+ * whenever it fills, so the trace is never stored. Draining keeps the
+ * finish time of the latest run of every value in each call frame, of
+ * the latest store to every 8-byte word, and for each window size w a
+ * ring of the last w retire times: in a window of w, an instruction
+ * enters once the instruction w before it has retired (in order). Phis
+ * take no window entry and no time.
+ *
+ * A call to a function with a body costs what its instrumented body does,
+ * a call to any other function its call summary. Memory is only followed
+ * through loads and stores.
+ */
+class LimitStudy
+{
+private:
+	enum kind_t{PLAIN, PHI, LOAD, STORE, CALL, RETURN, TERMINATOR};
+	static const uint32_t NONE = UINT32_MAX;
+
+	/// An instrumented instruction
+	struct Operation
+	{
+		uint32_t function;
+		uint32_t block;			//index in its function
+		uint32_t slot;			//of its value in the frame of its function
+		uint32_t latency;
+		uint32_t bytes;			//loads and stores
+		uint32_t operandStart;	//Operands of a phi are (block, slot) pairs
+		uint32_t operandEnd;
+		kind_t kind;
+		bool enters;			//first in the entry block: a new call
+		bool callsBody;			//a call that may enter an instrumented body
+	};
+
+	struct Frame
+	{
+		uint32_t function;
+		uint32_t block;			//NONE right after a terminator
+		uint32_t lastBlock;
+		uint32_t pendingCall;	//slot of the call into a body, NONE if none
+		std::vector<uint64_t> Times;	//finish times, one per window by slot
+		std::vector<uint64_t> PhiTimes;	//of the block's phis as it was entered
+	};
+
+	struct Event
+	{
+		uint32_t id;
+		uint64_t address;
+	};
+
+	llvm::Module &module;
+	const CostModel &costs;
+	const CallSummaries &calls;
+	std::vector<unsigned> Windows;	//0 for no window
+
+	std::vector<Operation> Operations;
+	std::vector<uint32_t> Operands;	//slots, NONE for constants
+	std::vector<uint32_t> Slots;	//by function
+	std::vector<uint32_t> Args;
+	std::vector< std::vector< std::pair<uint32_t, uint32_t> > > PhiSlots;	//by function and block
+
+	std::vector<Event> Events;
+	size_t eventCount;
+	std::vector<Frame> Frames;
+	size_t depth;
+	std::vector<uint64_t> CallArgs;
+	std::unordered_map<uint64_t, size_t> Memory;	//word to its MemoryTimes
+	std::vector<uint64_t> MemoryTimes;
+	std::vector< std::vector<uint64_t> > Retired;	//ring by window
+	std::vector<uint64_t> LastRetire;
+	std::vector<uint64_t> Span;
+	std::vector<uint64_t> Scratch;
+	uint64_t instructions;
+	uint64_t work;
+
+public:
+	/// windows holds the window sizes besides the unbounded one
+	LimitStudy(llvm::Module &module, const CostModel &costs, const CallSummaries &calls,
+	           std::vector<unsigned> windows);
+	~LimitStudy() {}
+
+	/// Runs entry on arguments (see buildCallWrapper); false (with an error
+	/// message) if it cannot be run
+	bool run(llvm::Function &entry, const std::string &arguments, LimitAnalysisInfo &limits);
+
+	/// Called by the instrumented code before every instruction it runs
+	static void trace(LimitStudy *study, uint32_t id, uint64_t address);
+
+private:
+	void instrument(llvm::Module &clone);
+	void drain();
+	void process(const Event &event);
+	Frame& enter(const Operation &operation);
+	uint64_t* getWordTimes(uint64_t word, bool create);
+};
+
+#endif /* LIMIT_STUDY_H */
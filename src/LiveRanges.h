@@ -0,0 +1,209 @@
+#ifndef LIVE_RANGES_H
+#define LIVE_RANGES_H
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "CostModel.h"
+#include "DAGNode.h"
+
+/// Values (and their bits) held at each step of one schedule
+struct LiveProfile
+{
+	unsigned width;		//operators per step, 0 for unlimited (ASAP)
+	std::vector<int> Values;	//by step
+	std::vector<uint64_t> Bits;
+	int peakValues;
+	uint64_t peakBits;
+
+	size_t getStepCount() const { return Values.size(); }
+};
+
+
+/**
+ * @brief LiveRanges
+ * Storage pressure of a locked, scheduled DAG. Operators (every node but
+ * the value nodes) run in unit steps; a value node is ready as soon as its
+ * dependences are done and is held from then until the step of its last
+ * user. Constants and allocas are wired in and never held.
+ *
+ * A schedule takes the ready operators step by step, the ones with the
+ * longest chain of dependents first (ties in IR order, so the schedule
+ * does not depend on the node IDs), at most width of them per step. With
+ * no width limit this is the ASAP schedule in operator steps and runs in
+ * time linear in the nodes, edges and steps; a width adds a heap of the
+ * ready operators. The chains come from one pass over the level order in
+ * reverse, the live counts from a difference array over the steps.
+ */
+class LiveRanges
+{
+private:
+	std::vector<DAGNode*> &Nodes;
+	std::vector<int> Height;	//longest chain of dependents, the node included
+	std::vector<uint64_t> ValueBits;	//0 for nodes that hold nothing
+	std::vector<uint8_t> Held;
+	std::vector<uint64_t> Priority;	//height above the inverted IR position
+
+public:
+	/// order holds every node ID, dependences first (the level order)
+	LiveRanges(std::vector<DAGNode*> &nodes, const std::vector<unsigned> &order) :
+		Nodes(nodes), Height(nodes.size(), 1), ValueBits(nodes.size(), 0), Held(nodes.size(), 0),
+		Priority(nodes.size(), 0)
+	{
+		for (size_t i = order.size(); i-- > 0; )
+		{
+			auto node = Nodes[ order[i] ];
+			for (auto predecessor_pair : node->getPredecessors())
+				Height[ order[i] ] = std::max(Height[ order[i] ], Height[ predecessor_pair.second->getID() ] + 1);
+		}
+
+		std::unordered_map<const llvm::Value*, uint32_t> Position;
+		for (auto node : Nodes)
+		{
+			auto inst = llvm::dyn_cast_or_null<llvm::Instruction>( node->getllvmValue() );
+			if ( inst == nullptr || !Position.empty() )
+				continue;
+			for (auto &BB : *inst->getFunction())
+			{
+				for (auto &I : BB)
+					Position.insert( std::make_pair(&I, (uint32_t)Position.size()) );
+			}
+		}
+		for (auto node : Nodes)
+		{
+			auto position = Position.find( node->getllvmValue() );
+			uint32_t rank = position != Position.end() ? UINT32_MAX - position->second : 0;
+			Priority[ node->getID() ] = ((uint64_t)Height[node->getID()] << 32) | rank;
+		}
+
+		for (auto node : Nodes)
+		{
+			auto value = node->getllvmValue();
+			if ( node->getType() != VAL || value == nullptr ||
+				 llvm::isa<llvm::Constant>(value) || llvm::isa<llvm::AllocaInst>(value) )
+				continue;
+			Held[ node->getID() ] = 1;
+			ValueBits[ node->getID() ] = CostModel::getBitWidth( value->getType() );
+		}
+	}
+
+	/// Operators that are not value nodes
+	size_t getOperatorCount()
+	{
+		size_t operators = 0;
+		for (auto node : Nodes)
+			operators += node->getType() != VAL;
+		return operators;
+	}
+
+	LiveProfile run(unsigned width)
+	{
+		size_t nodeCount = Nodes.size();
+		std::vector<int> pending(nodeCount), ready(nodeCount, 0), lastUse(nodeCount, -1);
+		std::vector<unsigned> Waiting;	//ready operators, a heap by priority with a width
+		auto byPriority = [this](unsigned a, unsigned b) { return Priority[a] < Priority[b]; };
+
+		// a node whose dependences are done at step t: operators wait,
+		// values are ready at once and release their users
+		std::vector<unsigned> released;
+		auto release = [&](unsigned id, int step) {
+			released.push_back(id);
+			while ( !released.empty() )
+			{
+				auto node = Nodes[ released.back() ];
+				released.pop_back();
+				if ( node->getType() != VAL )
+				{
+					Waiting.push_back( node->getID() );
+					if ( width != 0 )
+						std::push_heap(Waiting.begin(), Waiting.end(), byPriority);
+					continue;
+				}
+				ready[ node->getID() ] = step;
+				for (auto predecessor_pair : node->getPredecessors())
+				{
+					if ( --pending[ predecessor_pair.second->getID() ] == 0 )
+						released.push_back( predecessor_pair.second->getID() );
+				}
+			}
+		};
+		std::vector<unsigned> sources;
+		for (auto node : Nodes)
+		{
+			pending[ node->getID() ] = node->getSuccessors().size();
+			if ( pending[node->getID()] == 0 )
+				sources.push_back( node->getID() );
+		}
+		for (auto id : sources)
+			release(id, 0);
+
+		// one step at a time; the operators of a step are done at the
+		// start of the next one
+		int step = 0;
+		std::vector<unsigned> running;
+		while ( !Waiting.empty() )
+		{
+			running.clear();
+			if ( width == 0 )
+				running.swap(Waiting);
+			while ( !Waiting.empty() && running.size() < width )
+			{
+				std::pop_heap(Waiting.begin(), Waiting.end(), byPriority);
+				running.push_back( Waiting.back() );
+				Waiting.pop_back();
+			}
+			for (auto id : running)
+			{
+				for (auto successor_pair : Nodes[id]->getSuccessors())
+					lastUse[ successor_pair.second->getID() ] = std::max(lastUse[ successor_pair.second->getID() ], step);
+			}
+			step++;
+			for (auto id : running)
+			{
+				for (auto predecessor_pair : Nodes[id]->getPredecessors())
+				{
+					if ( --pending[ predecessor_pair.second->getID() ] == 0 )
+						release(predecessor_pair.second->getID(), step);
+				}
+			}
+		}
+
+		// each held value over [ready, last use], at least its ready step
+		LiveProfile profile = {width, std::vector<int>(step + 1, 0), std::vector<uint64_t>(step + 1, 0), 0, 0};
+		std::vector<int> valueDelta(step + 2, 0);
+		std::vector<int64_t> bitDelta(step + 2, 0);
+		for (auto node : Nodes)
+		{
+			auto id = node->getID();
+			if ( !Held[id] )
+				continue;
+			int end = std::max(ready[id], lastUse[id]) + 1;
+			valueDelta[ ready[id] ]++;
+			valueDelta[end]--;
+			bitDelta[ ready[id] ] += ValueBits[id];
+			bitDelta[end] -= ValueBits[id];
+		}
+		int values = 0;
+		int64_t bits = 0;
+		for (int s = 0; s <= step; ++s)
+		{
+			values += valueDelta[s];
+			bits += bitDelta[s];
+			profile.Values[s] = values;
+			profile.Bits[s] = bits;
+			profile.peakValues = std::max(profile.peakValues, values);
+			profile.peakBits = std::max(profile.peakBits, (uint64_t)bits);
+		}
+
+		// a last step that holds nothing is dropped
+		if ( profile.Values.size() > 1 && profile.Values.back() == 0 )
+		{
+			profile.Values.pop_back();
+			profile.Bits.pop_back();
+		}
+		return profile;
+	}
+};
+
+#endif /* LIVE_RANGES_H */
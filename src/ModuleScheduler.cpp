@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <exception>
+#include "ModuleScheduler.h"
+#include "FunctionInfoPass.h"
+#include "StructuralHash.h"
+#include "llvmEstimator.h"
+
+
+ModuleScheduler::ModuleScheduler(llvm::Module &module, unsigned threadCount, AnalysisCache_t *cache) :
+  module(module), threadCount(std::max(1u, threadCount)), functionThreads(1), cache(cache), reusedCount(0)
+{
+  buildSCCs();
+
+  /// Threads left over when there are fewer functions than threads build
+  /// the DAGs of each function in parallel
+  size_t functionCount = Summaries.size();
+  if ( functionCount != 0 && functionCount < this->threadCount )
+    functionThreads = this->threadCount / functionCount;
+}
+
+
+void
+ModuleScheduler::buildSCCs()
+{
+  /// scc_iterator visits the SCCs bottom-up, so callee SCCs are numbered
+  /// before their callers
+  llvm::CallGraph callGraph(module);
+  for (auto sccIter = llvm::scc_begin(&callGraph); !sccIter.isAtEnd(); ++sccIter)
+  {
+    SCC scc;
+    scc.pendingCallees = 0;
+    scc.hash = 0;
+    scc.skipped = false;
+    for (auto node : *sccIter)
+    {
+      auto function = node->getFunction();
+      if ( function == nullptr || function->isDeclaration() )
+        continue;
+      SCCOf[function] = SCCs.size();
+      Summaries[function] = nullptr;
+      scc.Functions.push_back(function);
+    }
+    if ( !scc.Functions.empty() )
+      SCCs.push_back(scc);
+  }
+
+  /// Edges between SCCs; calls within an SCC and to declarations or
+  /// unknown functions add none
+  for (unsigned caller = 0; caller < SCCs.size(); ++caller)
+  {
+    std::vector<unsigned> callees;
+    for (auto function : SCCs[caller].Functions)
+    {
+      for (auto &record : *callGraph[function])
+      {
+        auto callee = SCCOf.find( record.second->getFunction() );
+        if ( callee != SCCOf.end() && callee->second != caller )
+          callees.push_back(callee->second);
+      }
+    }
+    std::sort(callees.begin(), callees.end());
+    callees.erase( std::unique(callees.begin(), callees.end()), callees.end() );
+    for (auto callee : callees)
+      SCCs[callee].Callers.push_back(caller);
+    SCCs[caller].pendingCallees = callees.size();
+    SCCs[caller].Callees = callees;
+
+    /// Callees are numbered first, so their hashes are known. The hashes
+    /// are sorted to be the same whatever order the SCCs are found in.
+    if ( cache != nullptr )
+    {
+      std::vector<uint64_t> bodies, calleeHashes;
+      for (auto function : SCCs[caller].Functions)
+      {
+        Hashes[function] = StructuralHash::hashFunction(*function);
+        bodies.push_back( Hashes[function] );
+      }
+      for (auto callee : callees)
+        calleeHashes.push_back( SCCs[callee].hash );
+      std::sort(bodies.begin(), bodies.end());
+      std::sort(calleeHashes.begin(), calleeHashes.end());
+      auto &scc = SCCs[caller];
+      scc.hash = llvm::hash_combine( llvm::hash_value(module.getDataLayoutStr()),
+        llvm::hash_combine_range(bodies.begin(), bodies.end()),
+        llvm::hash_combine_range(calleeHashes.begin(), calleeHashes.end()) );
+      for (auto function : scc.Functions)
+        Hashes[function] = llvm::hash_combine(scc.hash, Hashes[function]);
+    }
+  }
+}
+
+
+void
+ModuleScheduler::run()
+{
+  /// The leaves are collected first: a task releases its callers, and a
+  /// pool of one thread runs them before async() returns
+  std::vector<unsigned> leaves;
+  for (unsigned scc = 0; scc < SCCs.size(); ++scc)
+  {
+    if ( SCCs[scc].pendingCallees == 0 )
+      leaves.push_back(scc);
+  }
+
+  WorkerPool pool(threadCount);
+  for (auto scc : leaves)
+    pool.async([this, scc, &pool]{ analyzeSCC(scc, pool); });
+  pool.wait();
+}
+
+
+void
+ModuleScheduler::restrictTo(const std::vector<llvm::Function*> &functions)
+{
+  for (auto &scc : SCCs)
+    scc.skipped = true;
+  std::vector<unsigned> stack;
+  for (auto function : functions)
+  {
+    auto scc = SCCOf.find(function);
+    if ( scc != SCCOf.end() && SCCs[scc->second].skipped )
+    {
+      SCCs[scc->second].skipped = false;
+      stack.push_back(scc->second);
+    }
+  }
+  while ( !stack.empty() )
+  {
+    unsigned scc = stack.back();
+    stack.pop_back();
+    for (auto callee : SCCs[scc].Callees)
+    {
+      if ( SCCs[callee].skipped )
+      {
+        SCCs[callee].skipped = false;
+        stack.push_back(callee);
+      }
+    }
+  }
+}
+
+
+bool
+ModuleScheduler::isSkipped(llvm::Function *function)
+{
+  auto scc = SCCOf.find(function);
+  return scc != SCCOf.end() && SCCs[scc->second].skipped;
+}
+
+
+unsigned
+ModuleScheduler::getAnalyzedCount()
+{
+  unsigned analyzed = 0;
+  for (auto &scc : SCCs)
+  {
+    if ( !scc.skipped )
+      analyzed += scc.Functions.size();
+  }
+  return analyzed - reusedCount;
+}
+
+
+FunctionAnalysisInfo*
+ModuleScheduler::getAnalysis(llvm::Function *function)
+{
+  auto summary = Summaries.find(function);
+  return summary != Summaries.end() ? summary->second : nullptr;
+}
+
+
+uint64_t
+ModuleScheduler::getHash(llvm::Function *function)
+{
+  auto hash = Hashes.find(function);
+  return hash != Hashes.end() ? hash->second : 0;
+}
+
+
+void
+ModuleScheduler::analyzeSCC(unsigned scc, WorkerPool &pool)
+{
+  /// Only this task writes the entries of its functions, and callers
+  /// start after it, so the table needs no lock
+  if ( !SCCs[scc].skipped && !reuseSCC(scc) )
+  {
+    EstimatorAnalysisManagers managers;
+    registerEstimatorAnalyses(managers, &Summaries, functionThreads);
+    for (auto function : SCCs[scc].Functions)
+    {
+      /// A function that cannot be analyzed is costed like an unknown
+      /// call, so that its callers and the rest of the module still are
+      FunctionAnalysisInfo *kept = nullptr;
+      try {
+        kept = keep( managers.FAM.getResult<FunctionInfoPass>(*function) );
+      } catch (const std::exception &e) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        llvm::errs() << " ERROR: " << function->getName() << "() was not analyzed ("
+                     << e.what() << "), its callers use the unknown call cost\n";
+        kept = new FunctionAnalysisInfo(function);
+        kept->opDepth = callSummaries.getUnknownCost().latency;
+        kept->area = callSummaries.getUnknownCost().area;
+        kept->unknownCalls = 1;
+        Kept.push_back( std::unique_ptr<FunctionAnalysisInfo>(kept) );
+      }
+      Summaries.find(function)->second = kept;
+      if ( cache != nullptr )
+      {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        cache->insert( std::make_pair(Hashes[function], kept) );
+      }
+    }
+  }
+
+  /// Release the callers whose callees are all done
+  std::vector<unsigned> ready;
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    for (auto caller : SCCs[scc].Callers)
+    {
+      if ( --SCCs[caller].pendingCallees == 0 )
+        ready.push_back(caller);
+    }
+  }
+  for (auto caller : ready)
+    pool.async([this, caller, &pool]{ analyzeSCC(caller, pool); });
+}
+
+
+/// Takes the results of an SCC from the cache, false if one is missing
+bool
+ModuleScheduler::reuseSCC(unsigned scc)
+{
+  if ( cache == nullptr )
+    return false;
+  std::vector<const FunctionAnalysisInfo*> cached;
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    for (auto function : SCCs[scc].Functions)
+    {
+      auto result = cache->find( Hashes[function] );
+      if ( result == cache->end() )
+        return false;
+      cached.push_back(result->second);
+    }
+    reusedCount += cached.size();
+  }
+  for (size_t i = 0; i < cached.size(); ++i)
+  {
+    auto function = SCCs[scc].Functions[i];
+    Summaries.find(function)->second = keep(*cached[i], function);
+  }
+  return true;
+}
+
+
+/// Copies a result out of the task's analysis managers. Callees that were
+/// analyzed through the managers instead of the table are copied too. A
+/// result reused from another module is given to reusedBy, and its
+/// callees are looked up by name in this one.
+FunctionAnalysisInfo*
+ModuleScheduler::keep(const FunctionAnalysisInfo &FA, llvm::Function *reusedBy)
+{
+  auto kept = new FunctionAnalysisInfo(FA);
+  FunctionAnalysis_t InnerFA;
+  if ( reusedBy != nullptr )
+    kept->setFunction(reusedBy);
+  for (auto &inner : FA.InnerFA)
+  {
+    auto callee = inner.first;
+    if ( reusedBy != nullptr && module.getFunction(callee->getName()) != nullptr )
+      callee = module.getFunction(callee->getName());
+    auto summary = Summaries.find(callee);
+    if ( summary != Summaries.end() && summary->second != nullptr )
+      InnerFA[callee] = summary->second;
+    else
+      InnerFA[callee] = keep(*inner.second);
+  }
+  kept->InnerFA.swap(InnerFA);
+
+  std::lock_guard<std::mutex> lock(stateMutex);
+  Kept.push_back( std::unique_ptr<FunctionAnalysisInfo>(kept) );
+  return kept;
+}
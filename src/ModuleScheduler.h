@@ -0,0 +1,96 @@
+#ifndef MODULE_SCHEDULER_H
+#define MODULE_SCHEDULER_H
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <LLVMHeaders.h>
+
+#include "AnalysisInfo.h"
+#include "WorkerPool.h"
+
+/// Results by the hash of a function and its callees, shared by the
+/// schedulers of modules analyzed one after the other (which must outlive
+/// it), e.g. of one module optimized at several levels
+typedef std::unordered_map<uint64_t, const FunctionAnalysisInfo*> AnalysisCache_t;
+
+/**
+ * @brief ModuleScheduler
+ * Analyzes every function with a body in a module, callees before callers.
+ * The call graph is split into SCCs, which form a DAG; each SCC becomes a
+ * task that is released as soon as the SCCs it calls are done, so
+ * independent parts of the call graph are analyzed in parallel. Every
+ * task has its own analysis managers (they are not thread safe) and reads
+ * its callees' results from a shared summary table instead of analyzing
+ * them again. Results are copied out of the task's managers, which are
+ * freed when the task ends.
+ *
+ * Given a cache, every function is hashed with its callees (its
+ * StructuralHash, those of the other functions of its SCC and the hashes
+ * of the SCCs it calls) and an SCC whose functions are all in the cache
+ * takes their results instead of being analyzed. The hashes are taken
+ * when the scheduler is built, so a function optimized afterwards must be
+ * optimized the same way in every module sharing the cache.
+ *
+ * The IR must not change while the scheduler runs: optimize first.
+ */
+class ModuleScheduler
+{
+private:
+	struct SCC
+	{
+		std::vector<llvm::Function*> Functions;
+		std::vector<unsigned> Callers;	//SCCs that call into this one
+		std::vector<unsigned> Callees;
+		unsigned pendingCallees;		//callee SCCs not yet analyzed
+		uint64_t hash;					//with a cache only
+		bool skipped;					//see restrictTo()
+	};
+
+	llvm::Module &module;
+	unsigned threadCount;		//functions analyzed at the same time
+	unsigned functionThreads;	//threads within one function
+	std::vector<SCC> SCCs;
+	std::map<llvm::Function*, unsigned> SCCOf;
+	FunctionAnalysis_t Summaries; //every function has an entry before run()
+	std::vector< std::unique_ptr<FunctionAnalysisInfo> > Kept;
+	std::mutex stateMutex;
+	AnalysisCache_t *cache;
+	std::map<llvm::Function*, uint64_t> Hashes;	//with a cache only
+	unsigned reusedCount;
+
+public:
+	ModuleScheduler(llvm::Module &module, unsigned threadCount, AnalysisCache_t *cache=nullptr);
+
+	/// Analyzes every function with a body
+	void run();
+
+	/// Makes run() analyze only the given functions and their callees
+	void restrictTo(const std::vector<llvm::Function*> &functions);
+
+	/// Whether run() leaves a function with a body without a result
+	bool isSkipped(llvm::Function *function);
+
+	/// Result of a function with a body after run(), else nullptr
+	FunctionAnalysisInfo* getAnalysis(llvm::Function *function);
+
+	size_t getSCCCount() { return SCCs.size(); }
+
+	/// Hash of a function with a body and its callees, 0 without a cache
+	uint64_t getHash(llvm::Function *function);
+
+	/// Functions whose result was taken from the cache
+	unsigned getReusedCount() { return reusedCount; }
+
+	/// Functions analyzed by run(), not skipped nor reused
+	unsigned getAnalyzedCount();
+
+private:
+	void buildSCCs();
+	void analyzeSCC(unsigned scc, WorkerPool &pool);
+	bool reuseSCC(unsigned scc);
+	FunctionAnalysisInfo* keep(const FunctionAnalysisInfo &FA, llvm::Function *reusedBy=nullptr);
+};
+
+#endif /* MODULE_SCHEDULER_H */
@@ -0,0 +1,254 @@
+#ifndef SVG_RENDERER_H
+#define SVG_RENDERER_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "DAGNode.h"
+#include "DOTWriter.h"
+#include "WorkerPool.h"
+
+/**
+ * @brief SVGRenderer
+ * Draws a scheduled DAG without an external layout tool. A node sits at
+ * x = its ASAP level (dependences on the left, results on the right) and
+ * y = its slot within the level; slots are ordered by the mean slot of
+ * each node's dependences to keep edges short. Edges are straight lines.
+ * Levels are rendered in parallel into per-level chunks that are written
+ * in order, a batch at a time, so memory stays bounded. The critical path
+ * is drawn in red.
+ */
+class SVGRenderer
+{
+private:
+	static const int ColumnWidth = 140;
+	static const int RowHeight = 28;
+	static const int Margin = 24;
+	static const int Radius = 6;
+	static const size_t LabelLimit = 5000; //larger graphs keep labels as tooltips
+
+	std::vector<DAGNode*> &Nodes;
+	std::vector<int> &Level;
+	std::vector<int> &Finish;
+	std::vector<int> &After;
+	std::vector<unsigned> Order;	//node IDs by level, then slot
+	std::vector<size_t> &LevelStart;
+	std::vector<unsigned> Slot;
+	int criticalLength;
+
+public:
+	SVGRenderer(std::vector<DAGNode*> &nodes, std::vector<int> &level, std::vector<int> &finish,
+				std::vector<int> &after, std::vector<unsigned> &levelOrder, std::vector<size_t> &levelStart) :
+		Nodes(nodes), Level(level), Finish(finish), After(after), Order(levelOrder), LevelStart(levelStart),
+		criticalLength(0)
+	{
+		for (auto length : Finish)
+			criticalLength = std::max(criticalLength, length);
+	}
+
+	bool write(DOTWriter &out, llvm::StringRef functionName, WorkerPool &pool)
+	{
+		assignSlots();
+
+		// level 0 is empty, levels 1 .. height are columns
+		size_t columns = LevelStart.size() - 2, maxSlots = 0;
+		for (size_t l = 0; l+1 < LevelStart.size(); ++l)
+			maxSlots = std::max(maxSlots, LevelStart[l+1] - LevelStart[l]);
+		uint64_t width = 2*Margin + (columns > 0 ? columns - 1 : 0)*ColumnWidth + (Nodes.size() <= LabelLimit ? ColumnWidth : 0);
+		uint64_t height = 2*Margin + (maxSlots > 0 ? maxSlots - 1 : 0)*RowHeight;
+		std::string title;
+		appendEscaped(title, functionName);
+
+		out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+		out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+		out.writeNumber(width) << "\" height=\"";
+		out.writeNumber(height) << "\" viewBox=\"0 0 ";
+		out.writeNumber(width) << " ";
+		out.writeNumber(height) << "\">\n<title>" << title << "_DAG</title>\n";
+		out << "<style>line{stroke:#999;stroke-width:1}line.c{stroke:#d00;stroke-width:2}"
+			   "circle{fill:#fff;stroke:#333}circle.i{fill:#9cf}circle.f{fill:#9c9}circle.b{fill:#fc9}"
+			   "circle.c{stroke:#d00;stroke-width:2}text{font:10px sans-serif}</style>\n";
+
+		// edges first so the nodes are drawn over them
+		out << "<g>\n";
+		writeLevels(out, pool, [this](size_t level, std::string &chunk) { renderEdges(level, chunk); });
+		out << "</g>\n<g>\n";
+		writeLevels(out, pool, [this](size_t level, std::string &chunk) { renderNodes(level, chunk); });
+		out << "</g>\n</svg>\n";
+		return true;
+	}
+
+private:
+	/// Orders each level by the mean slot of the nodes' dependences, which
+	/// all sit on lower levels
+	void assignSlots()
+	{
+		Slot.assign(Nodes.size(), 0);
+		std::vector<double> key(Nodes.size(), 0);
+		for (size_t l = 0; l+1 < LevelStart.size(); ++l)
+		{
+			auto begin = Order.begin() + LevelStart[l], end = Order.begin() + LevelStart[l+1];
+			for (auto iter = begin; iter != end; ++iter)
+			{
+				auto node = Nodes[*iter];
+				double sum = 0;
+				for (auto successor_pair : node->getSuccessors())
+					sum += Slot[ successor_pair.second->getID() ];
+				key[*iter] = node->hasSuccessors() ? sum / node->getSuccessors().size() : *iter;
+			}
+			std::stable_sort(begin, end, [&key](unsigned a, unsigned b) { return key[a] < key[b]; });
+			for (auto iter = begin; iter != end; ++iter)
+				Slot[*iter] = iter - begin;
+		}
+	}
+
+	template <typename Renderer>
+	void writeLevels(DOTWriter &out, WorkerPool &pool, Renderer render)
+	{
+		size_t levelCount = LevelStart.size() - 1;
+		size_t batch = pool.size() * 4;
+		std::vector<std::string> chunks(batch);
+		for (size_t first = 0; first < levelCount; first += batch)
+		{
+			size_t count = std::min(batch, levelCount - first);
+			pool.parallelFor(count, [&](size_t i) {
+				chunks[i].clear();
+				render(first + i, chunks[i]);
+			});
+			for (size_t i = 0; i < count; ++i)
+				out.write(chunks[i].data(), chunks[i].size());
+		}
+	}
+
+	void renderEdges(size_t level, std::string &chunk)
+	{
+		for (size_t i = LevelStart[level]; i < LevelStart[level+1]; ++i)
+		{
+			auto node = Nodes[ Order[i] ];
+			for (auto successor_pair : node->getSuccessors())
+			{
+				auto successor = successor_pair.second;
+				chunk += "<line x1=\"";
+				appendNumber(chunk, getX(node));
+				chunk += "\" y1=\"";
+				appendNumber(chunk, getY(node));
+				chunk += "\" x2=\"";
+				appendNumber(chunk, getX(successor));
+				chunk += "\" y2=\"";
+				appendNumber(chunk, getY(successor));
+				chunk += isCriticalEdge(node, successor) ? "\" class=\"c\"/>\n" : "\"/>\n";
+			}
+		}
+	}
+
+	void renderNodes(size_t level, std::string &chunk)
+	{
+		for (size_t i = LevelStart[level]; i < LevelStart[level+1]; ++i)
+		{
+			auto node = Nodes[ Order[i] ];
+			chunk += "<circle cx=\"";
+			appendNumber(chunk, getX(node));
+			chunk += "\" cy=\"";
+			appendNumber(chunk, getY(node));
+			chunk += "\" r=\"";
+			appendNumber(chunk, Radius);
+			chunk += "\" class=\"";
+			chunk += getClass(node);
+			if ( isCritical(node) )
+				chunk += " c";
+			chunk += "\"><title>";
+			appendLabel(chunk, node);
+			chunk += "</title></circle>\n";
+
+			if ( Nodes.size() <= LabelLimit )
+			{
+				chunk += "<text x=\"";
+				appendNumber(chunk, getX(node) + Radius + 2);
+				chunk += "\" y=\"";
+				appendNumber(chunk, getY(node) + 3);
+				chunk += "\">";
+				appendLabel(chunk, node);
+				chunk += "</text>\n";
+			}
+		}
+	}
+
+	/// Levels start at 1 (nodes without dependences)
+	uint64_t getX(DAGNode *node)
+	{
+		return Margin + (uint64_t)(Level[ node->getID() ] - 1) * ColumnWidth;
+	}
+
+	uint64_t getY(DAGNode *node)
+	{
+		return Margin + (uint64_t)Slot[ node->getID() ] * RowHeight;
+	}
+
+	bool isCritical(DAGNode *node)
+	{
+		auto id = node->getID();
+		return Finish[id] + After[id] == criticalLength;
+	}
+
+	/// On the critical path the dependence finishes when the node starts
+	bool isCriticalEdge(DAGNode *node, DAGNode *successor)
+	{
+		return isCritical(node) && isCritical(successor) &&
+			   Finish[ successor->getID() ] == Finish[ node->getID() ] - node->getLatency();
+	}
+
+	static const char* getClass(DAGNode *node)
+	{
+		switch ( node->getType() ) {
+			case (INST):	return "i";
+			case (FUNC):	return "f";
+			case (BRANCH):	return "b";
+			default:		return "v";
+		}
+	}
+
+	static void appendLabel(std::string &chunk, DAGNode *node)
+	{
+		auto value = node->getllvmValue();
+		if ( node->getType() == INST )
+		{
+			chunk += llvm::cast<llvm::Instruction>(value)->getOpcodeName();
+			chunk += " ";
+		}
+		if ( !node->getConstName().empty() )
+			appendEscaped(chunk, node->getConstName());
+		else if ( value->hasName() )
+			appendEscaped(chunk, value->getName());
+		else
+			chunk += "&lt;no name&gt;";
+	}
+
+	static void appendEscaped(std::string &chunk, llvm::StringRef text)
+	{
+		for (auto c : text)
+		{
+			switch ( c ) {
+				case ('&'): chunk += "&amp;"; break;
+				case ('<'): chunk += "&lt;"; break;
+				case ('>'): chunk += "&gt;"; break;
+				case ('"'): chunk += "&quot;"; break;
+				default:    chunk += c;
+			}
+		}
+	}
+
+	static void appendNumber(std::string &chunk, uint64_t number)
+	{
+		char digits[20];
+		size_t count = 0;
+		do {
+			digits[count++] = '0' + number % 10;
+			number /= 10;
+		} while ( number != 0 );
+		while ( count != 0 )
+			chunk += digits[--count];
+	}
+};
+
+#endif /* SVG_RENDERER_H */
@@ -0,0 +1,160 @@
+#ifndef STRUCTURAL_HASH_H
+#define STRUCTURAL_HASH_H
+
+#include <unordered_map>
+#include <vector>
+#include <LLVMHeaders.h>
+
+/**
+ * @brief StructuralHash
+ * Hash of a function's body that is equal for structurally identical
+ * functions, whatever their module or context: the signature and
+ * attributes, then every instruction in order with its opcode, type, flags
+ * (predicates, wrap and fast-math flags, branch weights) and operands.
+ * Arguments, blocks and instructions are hashed by position and the
+ * globals and callees used by name, so renaming locals changes nothing
+ * while calling another function does. Only the body is hashed: a
+ * function's estimate also depends on its callees, which
+ * ModuleScheduler folds in over the call graph.
+ */
+class StructuralHash
+{
+private:
+	std::unordered_map<const llvm::Value*, unsigned> Positions;	//arguments, blocks and instructions
+	std::unordered_map<const llvm::Constant*, uint64_t> Constants;
+
+public:
+	static uint64_t hashFunction(const llvm::Function &function)
+	{
+		StructuralHash hasher;
+		return hasher.hash(function);
+	}
+
+private:
+	StructuralHash() {}
+
+	uint64_t hash(const llvm::Function &function)
+	{
+		/// Positions first: phis use values defined further down
+		unsigned position = 0;
+		for (auto &argument : function.args())
+			Positions[&argument] = position++;
+		for (auto &BB : function)
+		{
+			Positions[&BB] = position++;
+			for (auto &I : BB)
+				Positions[&I] = position++;
+		}
+
+		llvm::hash_code code = llvm::hash_combine( hashType(function.getFunctionType()),
+			function.getCallingConv(), hashString(function.getAttributes().getAsString(llvm::AttributeList::FunctionIndex)) );
+		for (auto &BB : function)
+		{
+			code = llvm::hash_combine(code, BB.size());
+			for (auto &I : BB)
+				code = llvm::hash_combine(code, hashInstruction(I));
+		}
+		return code;
+	}
+
+	uint64_t hashInstruction(const llvm::Instruction &I)
+	{
+		std::vector<uint64_t> operands;
+		for (auto &operand : I.operands())
+			operands.push_back( hashValue(operand.get()) );
+		if ( auto phi = llvm::dyn_cast<llvm::PHINode>(&I) )
+		{
+			for (auto block : phi->blocks())
+				operands.push_back( Positions[block] );
+		}
+
+		unsigned flags = 0;
+		uint64_t typeHash = 0;
+		if ( auto cmp = llvm::dyn_cast<llvm::CmpInst>(&I) )
+			flags = cmp->getPredicate();
+		else if ( auto GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(&I) )
+			typeHash = hashType( GEP->getSourceElementType() );
+		else if ( auto alloca = llvm::dyn_cast<llvm::AllocaInst>(&I) )
+			typeHash = hashType( alloca->getAllocatedType() );
+
+		llvm::hash_code code = llvm::hash_combine( I.getOpcode(), hashType(I.getType()), flags, typeHash,
+			I.getRawSubclassOptionalData(), llvm::hash_combine_range(operands.begin(), operands.end()) );
+		if ( auto weights = I.getMetadata(llvm::LLVMContext::MD_prof) )
+		{
+			for (auto &operand : weights->operands())
+			{
+				if ( auto weight = llvm::mdconst::dyn_extract_or_null<llvm::ConstantInt>(operand) )
+					code = llvm::hash_combine( code, llvm::hash_value(weight->getValue()) );
+			}
+		}
+		return code;
+	}
+
+	uint64_t hashValue(const llvm::Value *value)
+	{
+		auto position = Positions.find(value);
+		if ( position != Positions.end() )
+			return llvm::hash_combine( value->getValueID(), position->second );
+		if ( auto constant = llvm::dyn_cast<llvm::Constant>(value) )
+			return hashConstant(constant);
+		if ( auto assembly = llvm::dyn_cast<llvm::InlineAsm>(value) )
+			return llvm::hash_combine( hashString(assembly->getAsmString()), hashString(assembly->getConstraintString()) );
+		return llvm::hash_combine( value->getValueID(), hashType(value->getType()) );
+	}
+
+	uint64_t hashConstant(const llvm::Constant *constant)
+	{
+		auto known = Constants.find(constant);
+		if ( known != Constants.end() )
+			return known->second;
+
+		llvm::hash_code code = llvm::hash_combine( constant->getValueID(), hashType(constant->getType()) );
+		if ( auto global = llvm::dyn_cast<llvm::GlobalValue>(constant) )
+			code = llvm::hash_combine( code, hashString(global->getName()) );
+		else if ( auto integer = llvm::dyn_cast<llvm::ConstantInt>(constant) )
+			code = llvm::hash_combine( code, llvm::hash_value(integer->getValue()) );
+		else if ( auto real = llvm::dyn_cast<llvm::ConstantFP>(constant) )
+			code = llvm::hash_combine( code, llvm::hash_value(real->getValueAPF().bitcastToAPInt()) );
+		else if ( auto data = llvm::dyn_cast<llvm::ConstantDataSequential>(constant) )
+			code = llvm::hash_combine( code, hashString(data->getRawDataValues()) );
+		else
+		{
+			if ( auto expression = llvm::dyn_cast<llvm::ConstantExpr>(constant) )
+				code = llvm::hash_combine( code, expression->getOpcode() );
+			for (auto &operand : constant->operands())
+				code = llvm::hash_combine( code, hashValue(operand.get()) );
+		}
+		Constants[constant] = code;
+		return code;
+	}
+
+	/// Types belong to a context, so they are hashed by their structure
+	/// (and structs by name, which also ends recursive types)
+	static uint64_t hashType(llvm::Type *type)
+	{
+		llvm::hash_code code = llvm::hash_value( (unsigned)type->getTypeID() );
+		if ( auto structType = llvm::dyn_cast<llvm::StructType>(type) )
+		{
+			if ( structType->hasName() )
+				return llvm::hash_combine( code, hashString(structType->getName()) );
+		}
+		if ( type->isIntegerTy() )
+			return llvm::hash_combine( code, type->getIntegerBitWidth() );
+		if ( auto array = llvm::dyn_cast<llvm::ArrayType>(type) )
+			code = llvm::hash_combine( code, array->getNumElements() );
+		else if ( type->isVectorTy() )
+			code = llvm::hash_combine( code, type->getVectorNumElements() );
+		else if ( auto pointer = llvm::dyn_cast<llvm::PointerType>(type) )
+			code = llvm::hash_combine( code, pointer->getAddressSpace() );
+		for (auto contained : type->subtypes())
+			code = llvm::hash_combine( code, hashType(contained) );
+		return code;
+	}
+
+	static uint64_t hashString(llvm::StringRef text)
+	{
+		return llvm::hash_value(text);
+	}
+};
+
+#endif /* STRUCTURAL_HASH_H */
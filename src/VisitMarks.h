@@ -0,0 +1,59 @@
+#ifndef VISIT_MARKS_H
+#define VISIT_MARKS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief VisitMarks
+ * Visitation state owned by one traversal, indexed by dense node ID. A
+ * node is visited when its mark equals the current epoch, so starting a
+ * new walk with reset() is a single increment instead of a pass over the
+ * nodes. Traversals never write to the DAG, so any number of them may
+ * walk the same locked DAG at once, each with its own marks.
+ */
+class VisitMarks
+{
+private:
+	std::vector<uint32_t> Marks;
+	uint32_t epoch;
+
+public:
+	VisitMarks(size_t nodeCount=0) : Marks(nodeCount, 0), epoch(1) {}
+
+	/// Forget every mark
+	void reset()
+	{
+		epoch++;
+		if ( epoch == 0 ) // wrapped, old marks could match again
+		{
+			std::fill(Marks.begin(), Marks.end(), 0);
+			epoch = 1;
+		}
+	}
+
+	bool isVisited(unsigned id) const
+	{
+		return id < Marks.size() && Marks[id] == epoch;
+	}
+
+	/// Marks the node, returns false when it was already visited
+	bool visit(unsigned id)
+	{
+		if ( id >= Marks.size() )
+			Marks.resize(id + 1, 0);
+		if ( Marks[id] == epoch )
+			return false;
+		Marks[id] = epoch;
+		return true;
+	}
+
+	void unvisit(unsigned id)
+	{
+		if ( id < Marks.size() )
+			Marks[id] = 0;
+	}
+};
+
+#endif /* VISIT_MARKS_H */
@@ -0,0 +1,211 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief WorkerPool
+ * A fixed set of threads draining a shared task queue. wait() blocks until
+ * every queued task has finished. A pool of one thread runs each task
+ * inline so that serial runs do not pay for thread start-up.
+ */
+class WorkerPool
+{
+private:
+	std::vector<std::thread> Workers;
+	std::deque< std::function<void()> > Tasks;
+	std::mutex queueMutex;
+	std::condition_variable taskReady;
+	std::condition_variable allDone;
+	unsigned activeTasks;
+	bool stopping;
+
+public:
+	WorkerPool(unsigned threadCount) : activeTasks(0), stopping(false)
+	{
+		if ( threadCount <= 1 )
+			return;
+		for (unsigned i = 0; i < threadCount; ++i)
+			Workers.push_back( std::thread([this]{ work(); }) );
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		taskReady.notify_all();
+		for (auto &worker : Workers)
+			worker.join();
+	}
+
+	unsigned size() { return Workers.empty() ? 1 : Workers.size(); }
+
+	void async(std::function<void()> task)
+	{
+		if ( Workers.empty() )
+		{
+			task();
+			return;
+		}
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			Tasks.push_back(task);
+			activeTasks++;
+		}
+		taskReady.notify_one();
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		allDone.wait(lock, [this]{ return activeTasks == 0; });
+	}
+
+	/// Runs body(i) for every i in [0, count) split into contiguous chunks
+	void parallelFor(size_t count, std::function<void(size_t)> body)
+	{
+		size_t chunkCount = std::min(count, (size_t)size() * 4);
+		for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			size_t begin = count * chunk / chunkCount;
+			size_t end = count * (chunk + 1) / chunkCount;
+			async([begin, end, &body]{
+				for (size_t i = begin; i < end; ++i)
+					body(i);
+			});
+		}
+		wait();
+	}
+
+	/// Runs body(begin, end, worker) over [0, count) in pieces of at most
+	/// grain indices. Each worker starts on an equal share and, once it is
+	/// done, steals the back half of another worker's remaining share, so
+	/// pieces of uneven cost balance out. worker < size() is unique among
+	/// the bodies running at the same time, for per-thread buffers.
+	void parallelSteal(size_t count, size_t grain, std::function<void(size_t, size_t, unsigned)> body)
+	{
+		unsigned slots = size();
+		if ( slots == 1 || count <= grain )
+		{
+			if ( count != 0 )
+				body(0, count, 0);
+			return;
+		}
+
+		std::vector<Share> shares(slots);
+		for (unsigned slot = 0; slot < slots; ++slot)
+		{
+			shares[slot].begin = count * slot / slots;
+			shares[slot].end = count * (slot + 1) / slots;
+		}
+		for (unsigned slot = 0; slot < slots; ++slot)
+		{
+			async([slot, grain, &shares, &body]{
+				size_t begin, end;
+				while ( takePiece(shares, slot, grain, begin, end) )
+					body(begin, end, slot);
+			});
+		}
+		wait();
+	}
+
+	static unsigned defaultThreadCount()
+	{
+		unsigned count = std::thread::hardware_concurrency();
+		return count == 0 ? 1 : count;
+	}
+
+private:
+	/// The indices [begin, end) a worker of parallelSteal has left
+	struct Share
+	{
+		std::mutex lock;
+		size_t begin;
+		size_t end;
+	};
+
+	/// The next piece of the slot's own share, else a stolen half of the
+	/// largest other share; false when no work is left anywhere
+	static bool takePiece(std::vector<Share> &shares, unsigned slot, size_t grain, size_t &begin, size_t &end)
+	{
+		auto &own = shares[slot];
+		while ( true )
+		{
+			{
+				std::unique_lock<std::mutex> lock(own.lock);
+				if ( own.begin != own.end )
+				{
+					begin = own.begin;
+					end = std::min(own.end, begin + grain);
+					own.begin = end;
+					return true;
+				}
+			}
+
+			unsigned victim = slot;
+			size_t most = 0;
+			for (unsigned other = 0; other < shares.size(); ++other)
+			{
+				if ( other == slot )
+					continue;
+				std::unique_lock<std::mutex> lock(shares[other].lock);
+				if ( shares[other].end - shares[other].begin > most )
+				{
+					victim = other;
+					most = shares[other].end - shares[other].begin;
+				}
+			}
+			if ( victim == slot )
+				return false;
+
+			size_t stolenBegin, stolenEnd;
+			{
+				std::unique_lock<std::mutex> lock(shares[victim].lock);
+				auto &share = shares[victim];
+				if ( share.begin == share.end )
+					continue; //finished meanwhile, look again
+				stolenBegin = share.begin + (share.end - share.begin) / 2;
+				stolenEnd = share.end;
+				share.end = stolenBegin;
+			}
+			std::unique_lock<std::mutex> lock(own.lock);
+			own.begin = stolenBegin;
+			own.end = stolenEnd;
+		}
+	}
+
+	void work()
+	{
+		while ( true )
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				taskReady.wait(lock, [this]{ return stopping || !Tasks.empty(); });
+				if ( Tasks.empty() )
+					return;
+				task = Tasks.front();
+				Tasks.pop_front();
+			}
+
+			task();
+
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				activeTasks--;
+				if ( activeTasks == 0 )
+					allDone.notify_all();
+			}
+		}
+	}
+};
+
+#endif /* WORKER_POOL_H */
@@ -1,5 +1,7 @@
 #include <LLVMHeaders.h>
 #include <llvmEstimator.h>
+#include <cstdlib>
+#include <sstream>
 
 void runNoArgsFunction(llvm::Function* f, std::unique_ptr<llvm::Module>& module)
 {
@@ -8,6 +10,8 @@ void runNoArgsFunction(llvm::Function* f, std::unique_ptr<llvm::Module>& module)
   llvm::GenericValue value = engine->runFunction(f, Args);
 }
 
+/// Instrumented copies are compiled for a single run, so code generation
+/// is not optimized: it would take far longer than the run on large IR
 llvm::ExecutionEngine *buildExecutionEngine(std::unique_ptr<llvm::Module> &module)
 {
 	std::string collectedErrors;
@@ -15,6 +19,7 @@ llvm::ExecutionEngine *buildExecutionEngine(std::unique_ptr<llvm::Module> &modul
     llvm::EngineBuilder(std::move(module))
 		.setErrorStr(&collectedErrors)
     .setEngineKind(llvm::EngineKind::JIT)
+    .setOptLevel(llvm::CodeGenOpt::None)
 		.create();
 		
 	if ( !engine )
@@ -44,3 +49,66 @@ llvm::TargetMachine *buildTargetMachine()
 	return target->createTargetMachine(targetTriple, cpu, features, options, RM);
 }
 
+
+llvm::Function *buildCallWrapper(llvm::Module &module, llvm::Function &entry, const std::string &arguments,
+                                 std::vector< std::vector<char> > &Buffers)
+{
+  std::istringstream fields(arguments);
+  std::vector<std::string> Given;
+  std::string field;
+  while ( fields >> field )
+    Given.push_back(field);
+  if ( Given.size() > entry.arg_size() )
+  {
+    llvm::errs() << " ERROR: " << entry.getName() << "() takes " << entry.arg_size() << " arguments, "
+                 << Given.size() << " were given\n";
+    return nullptr;
+  }
+
+  auto &context = module.getContext();
+  std::vector<llvm::Value*> Args;
+  for (auto &argument : entry.args())
+  {
+    unsigned i = Args.size();
+    auto type = argument.getType();
+    const char *text = i < Given.size() ? Given[i].c_str() : nullptr;
+    char *end = nullptr;
+    if ( type->isIntegerTy() )
+    {
+      long long value = text != nullptr ? std::strtoll(text, &end, 0) : 64;
+      Args.push_back( llvm::ConstantInt::get(type, value, true) );
+    }
+    else if ( type->isFloatingPointTy() )
+    {
+      double value = text != nullptr ? std::strtod(text, &end) : 1.0;
+      Args.push_back( llvm::ConstantFP::get(type, value) );
+    }
+    else if ( type->isPointerTy() )
+    {
+      //buffers are zeroed and aligned for any vector access
+      unsigned long long size = text != nullptr ? std::strtoull(text, &end, 0) : 65536;
+      Buffers.push_back( std::vector<char>(size + 64, 0) );
+      uintptr_t address = ((uintptr_t)Buffers.back().data() + 63) & ~(uintptr_t)63;
+      Args.push_back( llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), address), type) );
+    }
+    else
+    {
+      llvm::errs() << " ERROR: Argument " << i << " of " << entry.getName() << "() has an unsupported type, "
+                   << "only integer, floating point and pointer arguments can be given\n";
+      return nullptr;
+    }
+    if ( text != nullptr && (end == text || *end != '\0') )
+    {
+      llvm::errs() << " ERROR: Argument " << i << " of " << entry.getName() << "() is not a number: '"
+                   << text << "'\n";
+      return nullptr;
+    }
+  }
+
+  auto wrapper = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+                                        llvm::GlobalValue::ExternalLinkage, "__estimator_entry", &module);
+  llvm::IRBuilder<> builder( llvm::BasicBlock::Create(context, "entry", wrapper) );
+  builder.CreateCall(&entry, Args);
+  builder.CreateRetVoid();
+  return wrapper;
+}
@@ -1,4 +1,6 @@
 #include <LLVMHeaders.h>
+#include "AnalysisInfo.h"
+#include "DAGFile.h"
 
 /**
  * @brief getOptLevel
@@ -10,6 +12,19 @@ llvm::PassBuilder::OptimizationLevel getOptLevel(std::string optLevel_str);
 llvm::ExecutionEngine *buildExecutionEngine(std::unique_ptr<llvm::Module> &module);
 llvm::TargetMachine *buildTargetMachine();
 
+/**
+ * @brief buildCallWrapper
+ * Adds a function without arguments to module that calls entry (in module)
+ * with constant arguments, so that MCJIT can run it; nullptr (with an
+ * error message) if the arguments do not fit.
+ * @param arguments Given in order, separated by spaces; missing ones take
+ * the default. An integer or floating point argument is its value (default
+ * 64 and 1.0), a pointer argument the size in bytes of a zeroed buffer
+ * (default 65536) that is kept in Buffers.
+ */
+llvm::Function *buildCallWrapper(llvm::Module &module, llvm::Function &entry, const std::string &arguments,
+                                 std::vector< std::vector<char> > &Buffers);
+
 llvm::Function* generateTest1(llvm::LLVMContext &context, llvm::IRBuilder<> &builder,
                               llvm::Module* module, int iters);
 llvm::Function* generateTest2(llvm::LLVMContext &context, llvm::IRBuilder<> &builder,
@@ -20,7 +35,106 @@ llvm::Function* generateTest3(llvm::LLVMContext &context, llvm::IRBuilder<> &bui
 std::unique_ptr<llvm::Module> readIRText(llvm::StringRef text, llvm::LLVMContext& context);
 std::unique_ptr<llvm::Module> readIRFile(llvm::StringRef fname, llvm::LLVMContext& context);
 
-llvm::FunctionAnalysisManager
-runDefaultOptimization(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel);
+/**
+ * @brief EstimatorAnalysisManagers
+ * The pass builder and analysis managers of one analysis run. The managers
+ * hold proxies to each other and callbacks into the pass builder, so they
+ * are kept together and must outlive every result taken from FAM. They are
+ * declared in the order that destroys them correctly.
+ */
+struct EstimatorAnalysisManagers
+{
+  llvm::PassBuilder passBuilder;
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+};
+
+/// Registers the analyses of the pipeline and FunctionInfoPass, which
+/// takes callee results from summaries when given
+void registerEstimatorAnalyses(EstimatorAnalysisManagers &managers,
+                               const FunctionAnalysis_t *summaries=nullptr, unsigned threadCount=0);
+
+void runDefaultOptimization(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel,
+                            EstimatorAnalysisManagers &managers);
+
+bool loadCostModel(std::string family, std::string fileName);
+
+/// Costs of calls without an analyzed callee: the unknown cost, then the
+/// summary file (which may override it with a '*' entry)
+bool loadCallSummaries(std::string fileName, int unknownLatency, int unknownArea);
+
+/// Fixpoint rounds of a recursive SCC before its estimate is cut off
+void setRecursionRounds(unsigned rounds);
+
+/// Peak ops/s and bytes/s of the target; with both set, each function
+/// and loop is reported as compute or memory bound
+bool setRoofline(double ops, double bandwidth);
+
+/// Operators per step of the list schedule the live values are also
+/// measured on (0: spread evenly over the ASAP steps); the timeline of
+/// both schedules goes to <fxn>_Live.csv in the DOT directory
+void setLiveValues(unsigned listWidth, bool timelineFlag);
+
+/// Groups isomorphic, independent expression trees and reports how many
+/// lanes they would fill and the width and depth once packed
+void setIsomorphicGroups(bool isomorphicFlag);
+
+/// Runs entry (default: the analyzed function, or main for a module)
+/// under MCJIT on the given arguments (see BlockProfiler) after the
+/// optimization, and weights every function it reaches by its block and
+/// edge counts per call
+void setProfile(bool profileFlag, std::string entry, std::string arguments);
+
+/// Weights the functions that were not profiled by the block and edge
+/// frequencies of their branch probabilities (on by default)
+void setStaticWeights(bool weightsFlag);
+
+/// Runs the profile entry on the profile arguments to find its dynamic
+/// critical path with no window and with each of the window sizes (see
+/// LimitStudy); false if a size is not a positive number
+bool setLimitStudy(bool limitFlag, std::string windows);
+
+void setAnalysisThreads(unsigned threadCount);
+
+/// Vector kernels of the schedule: auto, avx512, avx2 or scalar; false
+/// if the CPU lacks the instructions
+bool setSIMDLevel(std::string name);
+
+/// Merges structurally identical subexpressions before scheduling and
+/// reports the raw and deduplicated node counts
+void setHashConsing(bool hashConsFlag);
+
+void setDOTDirectory(std::string directory);
+
+void setSVGOutput(bool svgFlag);
+
+/// Writes each analyzed DAG to <directory>/<fxn>.dag (empty to stop)
+void setDAGDirectory(std::string directory);
+
+/// Maps a .dag file for read-only, zero-copy access; no LLVM pipeline runs
+std::unique_ptr<MappedDAG> loadDAGFile(std::string fileName);
+
+bool setDOTSummary(std::string cluster, unsigned topPaths, unsigned maxNodes, bool fold, bool chains);
+
+/// Optimizes and analyzes every function with a body, independent call
+/// graph SCCs in parallel (see ModuleScheduler)
+void runModuleAnalysis(llvm::Module &module, llvm::PassBuilder::OptimizationLevel optLevel, bool dotFlag);
 
 void runEstimatorAnalysis(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel, bool dotFlag);
+
+/// Optimizes a copy of the module at every level (the levels in parallel),
+/// analyzes each one reusing the results of the functions that come out
+/// the same as at an earlier level, and prints the instructions, operator
+/// depth and width of every function (or only functionName) side by side
+void runOptSweep(llvm::Module &module, std::string functionName);
+
+
+/// Compares two modules (e.g. two IR files, or one module and its clone
+/// at another level): functions are matched by name, then by structural
+/// hash, and the metrics that changed are printed for every function
+/// whose IR or callees differ (with a diff of the critical paths if
+/// pathFlag). Functions that did not change are not analyzed.
+void runCompare(llvm::Module &before, std::string beforeLevel, llvm::Module &after, std::string afterLevel,
+                bool pathFlag);
\ No newline at end of file
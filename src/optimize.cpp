@@ -1,5 +1,6 @@
 #include <LLVMHeaders.h>
 #include <stdlib.h>
+#include "llvmEstimator.h"
 #include "FunctionInfoPass.h"
 
 llvm::PassBuilder::OptimizationLevel getOptLevel(std::string optLevel_str)
@@ -23,20 +24,34 @@ llvm::PassBuilder::OptimizationLevel getOptLevel(std::string optLevel_str)
 }
 
 
-llvm::FunctionAnalysisManager
-runDefaultOptimization(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel)
+void
+registerEstimatorAnalyses(EstimatorAnalysisManagers &managers, const FunctionAnalysis_t *summaries,
+                          unsigned threadCount)
+{
+  llvm::PassBuilder &passBuilder = managers.passBuilder;
+
+  /// Register the passes used in the simplification pipeline
+	passBuilder.crossRegisterProxies(managers.LAM, managers.FAM, managers.CGAM, managers.MAM);
+
+	/// Custom analysis passes
+  managers.FAM.registerPass([=]{ return FunctionInfoPass(summaries, threadCount); });
+	// MAM->registerPass([&]{ return ModuleInfoPass(FAM); });
+
+	passBuilder.registerFunctionAnalyses(managers.FAM);
+	passBuilder.registerLoopAnalyses(managers.LAM);
+}
+
+void
+runDefaultOptimization(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel,
+                       EstimatorAnalysisManagers &managers)
 {
 	/// Function analysis and pass managers
 	bool DebugPM = false;
-	bool DebugAM = false;
 
-  llvm::PassBuilder passBuilder;
+  llvm::PassBuilder &passBuilder = managers.passBuilder;
   llvm::FunctionPassManager FPM(DebugPM);
 
-  llvm::ModuleAnalysisManager MAM(DebugAM);
-  llvm::CGSCCAnalysisManager CGAM(DebugAM);
-  llvm::FunctionAnalysisManager FAM(DebugAM);
-  llvm::LoopAnalysisManager LAM(DebugAM);
+  llvm::FunctionAnalysisManager &FAM = managers.FAM;
 
   if ( optLevel != llvm::PassBuilder::O0 )
   {
@@ -47,20 +62,9 @@ runDefaultOptimization(llvm::Function& f, llvm::PassBuilder::OptimizationLevel o
   }
 	
 
-  /// Register the passes used in the simplification pipeline
-	passBuilder.crossRegisterProxies(LAM, FAM, CGAM, MAM);
-
-	/// Custom analysis passes
-  FAM.registerPass([&]{ return FunctionInfoPass(); });
-	// MAM->registerPass([&]{ return ModuleInfoPass(FAM); });
-
-	passBuilder.registerFunctionAnalyses(FAM);
-	passBuilder.registerLoopAnalyses(LAM);
+  registerEstimatorAnalyses(managers);
 
   if ( optLevel != llvm::PassBuilder::O0) {
     FPM.run(f, FAM);
   }
-
-  return FAM;
 }
-
@@ -1,19 +1,188 @@
 #include <LLVMHeaders.h>
+#include <set>
 #include "llvmEstimator.h"
 #include "FunctionInfoPass.h"
+#include "LimitStudy.h"
+#include "ModuleScheduler.h"
 
 //use to set the extern flag declared FunctionInfoPass.h
 bool generateDOT;
+bool generateSVG = false;
+std::string dotDirectory = "../../dotFiles";
+DOTSummaryOptions dotSummary;
+std::string dagDirectory;
+CostModel costModel;
+unsigned analysisThreads = 1;
+bool hashConsing = false;
+CallSummaries callSummaries;
+unsigned recursionRounds = 8;
+unsigned liveListWidth = 0;
+bool liveTimeline = false;
+bool isomorphicGroups = false;
+BlockProfiles_t blockProfiles;
+bool staticWeights = true;
+bool criticalPaths = false;
+static bool profileRun = false;
+static std::string profileEntry;
+static std::string profileArguments;
+static bool limitRun = false;
+static std::vector<unsigned> limitWindows;
+double peakOps = 0;
+double peakBandwidth = 0;
 
-void runEstimatorAnalysis(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel, bool dotFlag)
+bool loadCostModel(std::string family, std::string fileName)
+{
+  if ( !family.empty() && !costModel.loadFamily(family) )
+    return false;
+  if ( !fileName.empty() && !costModel.loadFile(fileName) )
+    return false;
+  return true;
+}
+
+bool loadCallSummaries(std::string fileName, int unknownLatency, int unknownArea)
+{
+  if ( unknownLatency < 0 || unknownArea < 0 )
+  {
+    llvm::errs() << " ERROR: The unknown call cost must not be negative\n";
+    return false;
+  }
+  CallCost unknownCost;
+  unknownCost.latency = unknownLatency;
+  unknownCost.area = unknownArea;
+  callSummaries.setUnknownCost(unknownCost);
+  return fileName.empty() || callSummaries.loadFile(fileName);
+}
+
+void setRecursionRounds(unsigned rounds)
+{
+  recursionRounds = rounds;
+}
+
+bool setRoofline(double ops, double bandwidth)
+{
+  if ( ops < 0 || bandwidth < 0 )
+  {
+    llvm::errs() << " ERROR: The roofline peaks must not be negative\n";
+    return false;
+  }
+  peakOps = ops;
+  peakBandwidth = bandwidth;
+  return true;
+}
+
+void setLiveValues(unsigned listWidth, bool timelineFlag)
+{
+  liveListWidth = listWidth;
+  liveTimeline = timelineFlag;
+}
+
+void setIsomorphicGroups(bool isomorphicFlag)
+{
+  isomorphicGroups = isomorphicFlag;
+}
+
+void setProfile(bool profileFlag, std::string entry, std::string arguments)
+{
+  profileRun = profileFlag;
+  profileEntry = entry;
+  profileArguments = arguments;
+}
+
+void setStaticWeights(bool weightsFlag)
+{
+  staticWeights = weightsFlag;
+}
+
+bool setLimitStudy(bool limitFlag, std::string windows)
+{
+  limitRun = limitFlag;
+  limitWindows.clear();
+  std::istringstream fields(windows);
+  std::string field;
+  while ( fields >> field )
+  {
+    char *end = nullptr;
+    long window = std::strtol(field.c_str(), &end, 10);
+    if ( *end != '\0' || window <= 0 )
+    {
+      llvm::errs() << " ERROR: Window size '" << field << "' is not a positive number\n";
+      return false;
+    }
+    limitWindows.push_back(window);
+  }
+  return true;
+}
+
+void setAnalysisThreads(unsigned threadCount)
+{
+  analysisThreads = threadCount == 0 ? WorkerPool::defaultThreadCount() : threadCount;
+}
+
+bool setSIMDLevel(std::string name)
+{
+  simd_t level;
+  return FrontierKernels::parseLevel(name, level) && FrontierKernels::get().select(level);
+}
+
+void setHashConsing(bool hashConsFlag)
+{
+  hashConsing = hashConsFlag;
+}
+
+void setDOTDirectory(std::string directory)
+{
+  dotDirectory = directory;
+}
+
+void setSVGOutput(bool svgFlag)
+{
+  generateSVG = svgFlag;
+}
+
+void setDAGDirectory(std::string directory)
+{
+  dagDirectory = directory;
+}
+
+std::unique_ptr<MappedDAG> loadDAGFile(std::string fileName)
+{
+  std::unique_ptr<MappedDAG> dag(new MappedDAG);
+  std::string error;
+  if ( !dag->open(fileName, error) )
+  {
+    llvm::errs() << " ERROR: DAG file " << error << "\n";
+    return nullptr;
+  }
+  return dag;
+}
+
+bool setDOTSummary(std::string cluster, unsigned topPaths, unsigned maxNodes, bool fold, bool chains)
+{
+  if ( cluster == "block" )
+    dotSummary.cluster = BLOCK_CLUSTER;
+  else if ( cluster == "loop" )
+    dotSummary.cluster = LOOP_CLUSTER;
+  else if ( cluster == "none" )
+    dotSummary.cluster = NO_CLUSTER;
+  else
+  {
+    llvm::errs() << " ERROR: Unknown DOT clustering '" << cluster << "' (expected block, loop or none)\n";
+    return false;
+  }
+  dotSummary.enabled = true;
+  dotSummary.topPaths = topPaths;
+  dotSummary.maxNodes = maxNodes;
+  dotSummary.foldIsomorphic = fold;
+  dotSummary.collapseChains = chains;
+  return true;
+}
+
+static void printFunctionAnalysis(FunctionAnalysisInfo &FA)
 {
-  llvm::FunctionAnalysisManager FAM = runDefaultOptimization(f, optLevel);
-  generateDOT = dotFlag;
-  auto &FA = FAM.getResult<FunctionInfoPass>(f);
   if (generateDOT)
   {
   	llvm::outs() << " -- Convert to image files by:\n";
-  	llvm::outs() << "    -- Navigating to dotFiles/ with: cd ../../dotFiles\n";
+  	llvm::outs() << "    -- Navigating to the DOT directory with: cd " << dotDirectory << "\n";
   	llvm::outs() << "    -- Running: ../scripts/dot_to_png\n";
   }
   llvm::outs() << "----------------------------------------\n";
@@ -21,3 +190,327 @@ void runEstimatorAnalysis(llvm::Function& f, llvm::PassBuilder::OptimizationLeve
   llvm::outs() << "----------------------------------------\n";
 }
 
+/// The function run by --profile and --limit-study: the profile entry if
+/// one is set, else defaultEntry
+static llvm::Function* getRunEntry(llvm::Module &module, llvm::Function *defaultEntry)
+{
+  auto entry = profileEntry.empty() ? defaultEntry : module.getFunction(profileEntry);
+  if ( entry == nullptr || entry->isDeclaration() )
+  {
+    llvm::errs() << " ERROR: Entry '" << (profileEntry.empty() ? "main" : profileEntry)
+                 << "' not found, nothing is run\n";
+    return nullptr;
+  }
+  return entry;
+}
+
+/// Runs entry on the optimized IR; a failed run only leaves the
+/// estimates unweighted
+static void runProfile(llvm::Module &module, llvm::Function *entry)
+{
+  if ( !profileRun || entry == nullptr )
+    return;
+  BlockProfiler profiler(module);
+  if ( !profiler.run(*entry, profileArguments, blockProfiles) )
+    llvm::errs() << " ERROR: " << entry->getName() << "() was not profiled, the estimates are not weighted\n";
+}
+
+static bool runLimitStudy(llvm::Module &module, llvm::Function *entry, LimitAnalysisInfo &limits)
+{
+  if ( !limitRun || entry == nullptr )
+    return false;
+  LimitStudy study(module, costModel, callSummaries, limitWindows);
+  if ( study.run(*entry, profileArguments, limits) )
+    return true;
+  llvm::errs() << " ERROR: The limit study of " << entry->getName() << "() did not run\n";
+  return false;
+}
+
+static void printLimitStudy(LimitAnalysisInfo &limits, const FunctionAnalysisInfo *FA)
+{
+  llvm::outs() << "----------------------------------------\n";
+  limits.printAnalysis(FA);
+  llvm::outs() << "----------------------------------------\n";
+}
+
+void runModuleAnalysis(llvm::Module &module, llvm::PassBuilder::OptimizationLevel optLevel, bool dotFlag)
+{
+  /// Optimization changes the IR, so every function is optimized before
+  /// any is analyzed
+  for (auto &function : module)
+  {
+    if ( function.isDeclaration() )
+      continue;
+    EstimatorAnalysisManagers managers;
+    runDefaultOptimization(function, optLevel, managers);
+  }
+  auto entry = profileRun || limitRun ? getRunEntry(module, module.getFunction("main")) : nullptr;
+  runProfile(module, entry);
+  LimitAnalysisInfo limits;
+  bool limited = runLimitStudy(module, entry, limits);
+
+  generateDOT = dotFlag;
+  ModuleScheduler scheduler(module, analysisThreads);
+  scheduler.run();
+  for (auto &function : module)
+  {
+    auto FA = scheduler.getAnalysis(&function);
+    if ( FA != nullptr )
+      printFunctionAnalysis(*FA);
+  }
+  if (limited)
+    printLimitStudy(limits, scheduler.getAnalysis(entry));
+}
+
+void runEstimatorAnalysis(llvm::Function& f, llvm::PassBuilder::OptimizationLevel optLevel, bool dotFlag)
+{
+  EstimatorAnalysisManagers managers;
+  runDefaultOptimization(f, optLevel, managers);
+  auto entry = profileRun || limitRun ? getRunEntry(*f.getParent(), &f) : nullptr;
+  runProfile(*f.getParent(), entry);
+  LimitAnalysisInfo limits;
+  bool limited = runLimitStudy(*f.getParent(), entry, limits);
+  generateDOT = dotFlag;
+  auto &FA = managers.FAM.getResult<FunctionInfoPass>(f);
+  printFunctionAnalysis(FA);
+  if (limited)
+    printLimitStudy(limits, entry == &f ? &FA : nullptr);
+}
+
+
+/// One level of the sweep. LLVM contexts are not thread safe, so each
+/// level has its own and the module is copied into it through bitcode.
+struct SweepLevel
+{
+  std::string name;
+  std::unique_ptr<llvm::LLVMContext> context;
+  std::unique_ptr<llvm::Module> module;
+  std::unique_ptr<ModuleScheduler> scheduler;
+};
+
+void runOptSweep(llvm::Module &module, std::string functionName)
+{
+  llvm::SmallVector<char, 0> bitcode;
+  llvm::raw_svector_ostream stream(bitcode);
+  llvm::WriteBitcodeToFile(module, stream);
+  llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), module.getName());
+
+  const char *names[] = {"0", "1", "2", "3", "s", "z"};
+  std::vector<SweepLevel> Levels(sizeof(names) / sizeof(names[0]));
+  std::mutex errorMutex;
+  {
+    WorkerPool pool( std::min<unsigned>(analysisThreads, Levels.size()) );
+    for (size_t i = 0; i < Levels.size(); ++i)
+    {
+      auto &level = Levels[i];
+      level.name = names[i];
+      pool.async([&level, &buffer, &errorMutex]{
+        level.context.reset(new llvm::LLVMContext);
+        auto parsed = llvm::parseBitcodeFile(buffer, *level.context);
+        if ( !parsed )
+        {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          llvm::errs() << " ERROR: O" << level.name << " was not swept ("
+                       << llvm::toString( parsed.takeError() ) << ")\n";
+          return;
+        }
+        level.module = std::move(*parsed);
+        auto optLevel = getOptLevel(level.name);
+        for (auto &function : *level.module)
+        {
+          if ( function.isDeclaration() )
+            continue;
+          EstimatorAnalysisManagers managers;
+          runDefaultOptimization(function, optLevel, managers);
+        }
+      });
+    }
+    pool.wait();
+  }
+
+  /// The levels are analyzed one after the other so that each reuses
+  /// what the earlier ones found, every level with all the threads
+  AnalysisCache_t cache;
+  unsigned analyzed = 0, reused = 0;
+  generateDOT = false;
+  for (auto &level : Levels)
+  {
+    if ( !level.module )
+      continue;
+    level.scheduler.reset( new ModuleScheduler(*level.module, analysisThreads, &cache) );
+    level.scheduler->run();
+    for (auto &function : *level.module)
+      analyzed += !function.isDeclaration();
+    reused += level.scheduler->getReusedCount();
+  }
+
+  size_t nameWidth = 8;
+  for (auto &function : module)
+  {
+    if ( !function.isDeclaration() && (functionName.empty() || function.getName() == functionName) )
+      nameWidth = std::max(nameWidth, function.getName().size());
+  }
+
+  llvm::outs() << "----------------------------------------\n";
+  llvm::outs() << "Optimization Sweep: " << reused << " of " << analyzed << " results reused\n";
+  llvm::outs() << llvm::left_justify("", nameWidth);
+  for (auto &level : Levels)
+    llvm::outs() << llvm::format("%21s", ("O" + level.name).c_str());
+  llvm::outs() << "\n" << llvm::left_justify("Function", nameWidth);
+  for (size_t i = 0; i < Levels.size(); ++i)
+    llvm::outs() << "  insts  depth  width";
+  llvm::outs() << "\n";
+  for (auto &function : module)
+  {
+    if ( function.isDeclaration() || (!functionName.empty() && function.getName() != functionName) )
+      continue;
+    llvm::outs() << llvm::left_justify(function.getName(), nameWidth);
+    for (auto &level : Levels)
+    {
+      auto FA = level.scheduler ? level.scheduler->getAnalysis( level.module->getFunction(function.getName()) ) : nullptr;
+      if ( FA == nullptr )
+        llvm::outs() << "      -      -      -";
+      else
+        llvm::outs() << llvm::format("%7u%7d%7d", FA->instCount, FA->opDepth, FA->opWidth);
+    }
+    llvm::outs() << "\n";
+  }
+  llvm::outs() << "----------------------------------------\n";
+}
+
+
+/// Optimizes the functions with a body of a module, or only those the
+/// scheduler will analyze
+static void optimizeFunctions(llvm::Module &module, llvm::PassBuilder::OptimizationLevel optLevel,
+                              ModuleScheduler *scheduler=nullptr)
+{
+  for (auto &function : module)
+  {
+    if ( function.isDeclaration() || (scheduler != nullptr && scheduler->isSkipped(&function)) )
+      continue;
+    EstimatorAnalysisManagers managers;
+    runDefaultOptimization(function, optLevel, managers);
+  }
+}
+
+static void printFunctionLine(const char *label, llvm::Function *function, ModuleScheduler &scheduler)
+{
+  llvm::outs() << "\t" << llvm::format("%16s", label) << " = " << function->getName() << "()";
+  auto FA = scheduler.getAnalysis(function);
+  if ( FA != nullptr )
+    llvm::outs() << ", " << FA->instCount << " insts, " << FA->opDepth << " cycles deep, " << FA->opWidth << " wide";
+  llvm::outs() << "\n";
+}
+
+void runCompare(llvm::Module &before, std::string beforeLevel, llvm::Module &after, std::string afterLevel,
+                bool pathFlag)
+{
+  /// At the same level, structurally identical functions are optimized
+  /// into the same IR, so the functions are matched before optimizing and
+  /// only the ones that will be analyzed are optimized
+  auto beforeOpt = getOptLevel(beforeLevel), afterOpt = getOptLevel(afterLevel);
+  bool sameLevel = beforeOpt == afterOpt;
+  if ( !sameLevel )
+  {
+    optimizeFunctions(before, beforeOpt);
+    optimizeFunctions(after, afterOpt);
+  }
+
+  AnalysisCache_t cache;
+  ModuleScheduler beforeScheduler(before, analysisThreads, &cache);
+  ModuleScheduler afterScheduler(after, analysisThreads, &cache);
+
+  /// Functions are matched by name, then those left by hash; a function
+  /// whose hash (which covers its callees) did not change is not analyzed
+  std::vector< std::pair<llvm::Function*, llvm::Function*> > Changed, Renamed;
+  std::vector<llvm::Function*> Removed, Added, Needed;
+  std::map< uint64_t, std::vector<llvm::Function*> > UnmatchedAfter;
+  std::set<llvm::Function*> RenamedTo;
+  unsigned unchanged = 0;
+  for (auto &function : after)
+  {
+    auto match = before.getFunction( function.getName() );
+    if ( !function.isDeclaration() && (match == nullptr || match->isDeclaration()) )
+      UnmatchedAfter[ afterScheduler.getHash(&function) ].push_back(&function);
+  }
+  for (auto &function : before)
+  {
+    if ( function.isDeclaration() )
+      continue;
+    auto match = after.getFunction( function.getName() );
+    if ( match != nullptr && !match->isDeclaration() )
+    {
+      if ( beforeScheduler.getHash(&function) == afterScheduler.getHash(match) )
+        unchanged++;
+      else
+        Changed.push_back( std::make_pair(&function, match) );
+      continue;
+    }
+    auto &candidates = UnmatchedAfter[ beforeScheduler.getHash(&function) ];
+    if ( candidates.empty() )
+    {
+      Removed.push_back(&function);
+      continue;
+    }
+    Renamed.push_back( std::make_pair(&function, candidates.front()) );
+    RenamedTo.insert( candidates.front() );
+    candidates.erase( candidates.begin() );
+  }
+  for (auto &function : after)
+  {
+    auto match = before.getFunction( function.getName() );
+    if ( !function.isDeclaration() && (match == nullptr || match->isDeclaration()) && RenamedTo.count(&function) == 0 )
+      Added.push_back(&function);
+  }
+
+  for (auto &pair : Changed)
+    Needed.push_back(pair.first);
+  Needed.insert(Needed.end(), Removed.begin(), Removed.end());
+  beforeScheduler.restrictTo(Needed);
+  Needed.clear();
+  for (auto &pair : Changed)
+    Needed.push_back(pair.second);
+  Needed.insert(Needed.end(), Added.begin(), Added.end());
+  afterScheduler.restrictTo(Needed);
+
+  if ( sameLevel )
+  {
+    optimizeFunctions(before, beforeOpt, &beforeScheduler);
+    optimizeFunctions(after, afterOpt, &afterScheduler);
+  }
+  generateDOT = false;
+  criticalPaths = pathFlag;
+  beforeScheduler.run();
+  afterScheduler.run();
+  criticalPaths = false;
+
+  llvm::outs() << "----------------------------------------\n";
+  llvm::outs() << "Comparison = " << before.getModuleIdentifier() << " (O" << beforeLevel << ") -> "
+               << after.getModuleIdentifier() << " (O" << afterLevel << ")\n";
+  llvm::outs() << "\t       Functions = " << Changed.size() << " changed, " << unchanged << " unchanged, "
+               << Renamed.size() << " renamed, " << Added.size() << " added, " << Removed.size() << " removed\n";
+  llvm::outs() << "\t        Analyzed = " << beforeScheduler.getAnalyzedCount() << " before, "
+               << afterScheduler.getAnalyzedCount() << " after\n";
+  for (auto &pair : Changed)
+  {
+    auto beforeFA = beforeScheduler.getAnalysis(pair.first);
+    auto afterFA = afterScheduler.getAnalysis(pair.second);
+    llvm::outs() << "----------------------------------------\n";
+    llvm::outs() << "\t     Function = " << pair.first->getName() << "()\n";
+    if ( beforeFA == nullptr || afterFA == nullptr )
+      continue;
+    if ( printAnalysisDelta(*beforeFA, *afterFA) == 0 )
+      llvm::outs() << "\t         Metrics = unchanged\n";
+    if ( pathFlag )
+      printPathDelta(beforeFA->CriticalPath, afterFA->CriticalPath);
+  }
+  if ( !Renamed.empty() || !Added.empty() || !Removed.empty() )
+    llvm::outs() << "----------------------------------------\n";
+  for (auto &pair : Renamed)
+    llvm::outs() << "\t         Renamed = " << pair.first->getName() << "() -> " << pair.second->getName() << "()\n";
+  for (auto function : Added)
+    printFunctionLine("Added", function, afterScheduler);
+  for (auto function : Removed)
+    printFunctionLine("Removed", function, beforeScheduler);
+  llvm::outs() << "----------------------------------------\n";
+}